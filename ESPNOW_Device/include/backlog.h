@@ -0,0 +1,30 @@
+#ifndef BACKLOG_H
+#define BACKLOG_H
+
+#include <Arduino.h>
+#include "protocol_v2.h"
+
+// Readings the Gateway did not acknowledge, kept in RTC memory.
+// Records are delta-encoded against their predecessor (see protocol_v2.h), so a
+// 1 KB buffer holds well over 100 samples; when it is full the oldest are dropped.
+// Once the link is back, the backlog is uploaded oldest first in MSG_BATCH
+// frames of at most 250 bytes, before the current reading.
+
+#define BACKLOG_BYTES 1024
+
+void backlogPush(const SensorSample& sample, uint16_t seq); // Timestamped with the RTC clock
+bool backlogEmpty();
+uint8_t backlogCount();
+
+/**
+ * Builds a MSG_BATCH frame from the oldest records (ages relative to now).
+ * `out` must hold BATCH_MAX_FRAME bytes. Returns the frame length (0 if empty)
+ * and the number of records it holds in `taken`.
+ */
+size_t backlogBuildBatch(uint8_t* out, uint8_t& taken);
+
+void backlogDrop(uint8_t count); // Remove the oldest `count` records (after the ACK)
+
+uint32_t backlogOverflows(); // Samples lost because the buffer was full
+
+#endif
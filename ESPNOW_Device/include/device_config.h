@@ -0,0 +1,95 @@
+#ifndef DEVICE_CONFIG_H
+#define DEVICE_CONFIG_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Runtime configuration cached in RTC memory.
+// The flash copies (/soil_config.json, ...) are only read on cold boot, when the
+// RTC block fails its checksum, or after they change (calibration). A normal
+// timer wake never mounts LittleFS or parses JSON.
+
+#define RUNTIME_CONFIG_VERSION 3
+
+// Report-on-change defaults (platformio.ini), overridable at runtime
+// with {"cmd":"report",...} while the device is in OTA mode.
+#ifndef DEADBAND_TEMPERATURE
+#define DEADBAND_TEMPERATURE 0.2  // °C
+#endif
+#ifndef DEADBAND_HUMIDITY
+#define DEADBAND_HUMIDITY    1.0  // %RH
+#endif
+#ifndef DEADBAND_PRESSURE
+#define DEADBAND_PRESSURE    0.5  // hPa
+#endif
+#ifndef DEADBAND_LUX_PCT
+#define DEADBAND_LUX_PCT     5    // % of the last sent value
+#endif
+#ifndef DEADBAND_SOIL
+#define DEADBAND_SOIL        2    // %
+#endif
+#ifndef DEADBAND_BATTERY
+#define DEADBAND_BATTERY     0.05 // V
+#endif
+#ifndef HEARTBEAT_INTERVAL
+#define HEARTBEAT_INTERVAL   300  // s, longest silence before a forced report
+#endif
+
+// Adaptive sleep bounds, overridable with {"cmd":"sleep","min":..,"max":..} via the Gateway
+#ifndef SLEEP_MIN_INTERVAL
+#define SLEEP_MIN_INTERVAL   15   // s
+#endif
+#ifndef SLEEP_MAX_INTERVAL
+#define SLEEP_MAX_INTERVAL   300  // s
+#endif
+
+struct RuntimeConfig {
+    uint16_t version;   // RUNTIME_CONFIG_VERSION
+    int16_t soilMin;    // Raw ADC, dry/air
+    int16_t soilMax;    // Raw ADC, wet/water
+    // Report-on-change, in SensorSample units
+    uint16_t heartbeatSec;
+    uint16_t dbTemperature; // 0.01 °C
+    uint16_t dbHumidity;    // 0.1 %RH
+    uint16_t dbPressure;    // 0.1 hPa
+    uint16_t dbBatteryMv;
+    uint8_t dbLuxPct;
+    uint8_t dbSoil;         // %
+    // Adaptive sleep bounds (s)
+    uint16_t sleepMinSec;
+    uint16_t sleepMaxSec;
+    uint16_t crc;       // crc16Ccitt over the fields above
+};
+
+/**
+ * Validates the RTC block, refreshing it from flash when needed.
+ * Returns true if the cached copy was used (no filesystem access).
+ */
+bool configBegin();
+
+const RuntimeConfig& runtimeConfig();
+
+/**
+ * Mounts LittleFS on demand (formats it if it cannot be mounted).
+ * Only the OTA and calibration paths need the filesystem.
+ */
+bool mountConfigFs();
+
+/**
+ * Stores a soil calibration point in flash and updates the RTC copy.
+ */
+void configSaveSoilCalibration(bool isWet, int raw);
+
+/**
+ * Applies report-on-change settings from a JSON object in user units
+ * ("temperature", "humidity", "pressure", "lux", "soil", "battery", "heartbeat";
+ * missing keys keep their value), stores them in flash and updates the RTC copy.
+ */
+void configSaveReporting(JsonVariantConst settings);
+
+/**
+ * Stores new adaptive sleep bounds in flash and updates the RTC copy.
+ */
+void configSaveSleepBounds(uint16_t minSec, uint16_t maxSec);
+
+#endif
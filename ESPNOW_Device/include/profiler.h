@@ -0,0 +1,23 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include "protocol.h"
+
+// Wake-cycle phase profiler.
+// Each profilerMark() closes the current phase, timed with esp_timer_get_time().
+// Per-phase min/sum/max accumulate in RTC memory across deep sleeps, only over
+// the wakes in which the phase ran, and a MSG_PROFILE summary is sent to the
+// Gateway every PROFILE_REPORT_EVERY wakes.
+
+#ifndef PROFILE_REPORT_EVERY
+#define PROFILE_REPORT_EVERY 20
+#endif
+
+void profilerBegin();                 // First thing in setup(): closes PHASE_BOOT
+void profilerMark(ProfilePhase phase); // Closes `phase`, the next one starts now
+void profilerEnd();                   // Closes PHASE_AWAKE and folds this wake into the stats
+bool profilerReportDue();
+void profilerBuildReport(ProfileMessage& msg); // Fills msg and starts a new window
+
+#endif
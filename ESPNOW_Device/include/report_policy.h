@@ -0,0 +1,35 @@
+#ifndef REPORT_POLICY_H
+#define REPORT_POLICY_H
+
+#include <Arduino.h>
+#include "protocol_v2.h"
+
+// Report-on-change.
+// The last sample the Gateway acknowledged is kept in RTC memory. A wake only
+// transmits when a reading moved beyond its deadband (RuntimeConfig) or when
+// nothing was sent for heartbeatSec. The first wake after power-on always sends.
+
+enum ReportReason : uint8_t {
+    REPORT_NONE,
+    REPORT_COLD_BOOT,
+    REPORT_HEARTBEAT,
+    REPORT_CHANGE
+};
+
+/**
+ * Reasons known before the sensors are read (cold boot, heartbeat),
+ * so the radio can be brought up in parallel. REPORT_NONE otherwise.
+ */
+ReportReason reportScheduled();
+
+/**
+ * Full decision for this wake, including the deadband check.
+ */
+ReportReason reportDecide(const SensorSample& sample);
+
+void reportAcknowledged(const SensorSample& sample); // Gateway ACKed `sample`
+void reportSleeping(uint32_t seconds);               // Called before every deep sleep
+
+const char* reportReasonName(ReportReason reason);
+
+#endif
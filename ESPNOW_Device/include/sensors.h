@@ -23,7 +23,11 @@ struct SensorReadings {
 
 void initSensors();
 
-SensorReadings readSensors();
+// Acquisition is split so that slow conversions run while the radio comes up:
+// startSensors() triggers every conversion, collectSensors() gathers the results.
+void startSensors();
+SensorReadings collectSensors();
+SensorReadings readSensors(); // startSensors() + collectSensors()
 void calibrateSoil(bool isWet);
 
 #endif
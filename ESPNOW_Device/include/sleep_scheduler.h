@@ -0,0 +1,33 @@
+#ifndef SLEEP_SCHEDULER_H
+#define SLEEP_SCHEDULER_H
+
+#include <Arduino.h>
+#include "report_policy.h"
+
+// Adaptive sleep interval.
+// The interval moves on a ladder min, 2*min, 4*min, ... with max as the top
+// rung (RuntimeConfig.sleepMinSec/sleepMaxSec), so it changes rarely and each
+// change can be announced with a CONFIG message:
+//  - a reading left its deadband       -> one step down (faster)
+//  - SLEEP_STABLE_WAKES quiet wakes     -> one step up (slower)
+//  - low battery                        -> the lowest rung >= half of max; critical -> max
+
+#ifndef SLEEP_STABLE_WAKES
+#define SLEEP_STABLE_WAKES 4
+#endif
+#ifndef SLEEP_BATTERY_LOW
+#define SLEEP_BATTERY_LOW      3.5 // V
+#endif
+#ifndef SLEEP_BATTERY_CRITICAL
+#define SLEEP_BATTERY_CRITICAL 3.3 // V
+#endif
+
+uint16_t sleepCurrentInterval(); // Interval this wake was scheduled with (s)
+
+/**
+ * Picks the interval for the coming sleep from this wake's report decision
+ * and battery level (0 = not battery powered). Returns seconds.
+ */
+uint16_t sleepNextInterval(ReportReason reason, uint16_t batteryMv);
+
+#endif
@@ -5,11 +5,14 @@
 #include <esp_now.h>
 #include <WiFi.h>
 #include "protocol.h"
+#include "protocol_v2.h"
 
 // Device-side transport functions
 void initTransport();
 bool sendConfigMessage(ConfigMessage msg);
-bool sendDataMessage(DataMessage msg);
+bool sendDataReliable(const SensorSample& sample, uint16_t seq); // Compact TLV uplink, retried until ACKed
+bool sendBatchReliable(const uint8_t* frame, size_t len); // MSG_BATCH, ACKed with its lastSeq
+bool sendProfileMessage(const ProfileMessage& msg); // Waits for the frame to leave before returning
 bool isOtaRequested();  // Check if OTA mode was requested via CMD
 void clearOtaRequest(); // Clear the flag
 bool isUpdateRequested(); 
@@ -18,5 +21,8 @@ bool isConfigRequestRequested();
 void clearConfigRequest();
 bool hasAckBeenReceived(); // Check if MSG_ACK was received
 void clearAckFlag();       // Reset the ACK flag
+bool waitForAck(uint16_t seq, uint32_t timeoutMs); // Wait for the ACK of `seq`
+bool takeSleepBoundsRequest(uint16_t& minSec, uint16_t& maxSec); // CMD_SLEEP received?
+bool waitForSent(uint32_t timeoutMs); // Wait until the last frame has left the radio
 
 #endif
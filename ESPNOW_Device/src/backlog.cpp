@@ -0,0 +1,126 @@
+#include "backlog.h"
+#include <time.h>
+
+// Zeroed on power-on, kept across deep sleep
+RTC_DATA_ATTR static uint8_t buf[BACKLOG_BYTES];
+RTC_DATA_ATTR static uint16_t used = 0;
+RTC_DATA_ATTR static uint8_t count = 0;
+RTC_DATA_ATTR static TimedSample newest; // Base for the next delta
+RTC_DATA_ATTR static uint32_t overflows = 0;
+
+// System time keeps running through deep sleep (RTC timer); unset it counts from power-on
+static uint32_t nowSec() {
+    return (uint32_t)time(nullptr);
+}
+
+static uint8_t sensorFlags() {
+    return newest.s.sensorFlags;
+}
+
+static void dropOldest() {
+    if (count <= 1) {
+        used = 0;
+        count = 0;
+        return;
+    }
+    TimedSample zero, first, second;
+    memset(&zero, 0, sizeof(zero));
+    size_t n0 = decodeSampleDelta(buf, used, zero, sensorFlags(), first);
+    size_t n1 = decodeSampleDelta(buf + n0, used - n0, first, sensorFlags(), second);
+
+    // The second record becomes the first: re-encode it relative to zero
+    uint8_t rec[SAMPLE_RECORD_MAX];
+    size_t m = encodeSampleDelta(second, zero, sensorFlags(), rec);
+    size_t rest = used - n0 - n1;
+    memmove(buf + m, buf + n0 + n1, rest);
+    memcpy(buf, rec, m);
+    used = m + rest;
+    count--;
+}
+
+void backlogPush(const SensorSample& sample, uint16_t seq) {
+    TimedSample cur;
+    cur.t = nowSec();
+    cur.seq = seq;
+    cur.s = sample;
+
+    // A flag change (reflash) invalidates the deltas: start over
+    if (count > 0 && sample.sensorFlags != sensorFlags()) {
+        overflows += count;
+        used = 0;
+        count = 0;
+    }
+
+    TimedSample zero;
+    memset(&zero, 0, sizeof(zero));
+    uint8_t rec[SAMPLE_RECORD_MAX];
+    size_t n = encodeSampleDelta(cur, count ? newest : zero, sample.sensorFlags, rec);
+    while (count > 0 && (used + n > BACKLOG_BYTES || count == 0xFF)) {
+        dropOldest();
+        overflows++;
+        if (count == 0) n = encodeSampleDelta(cur, zero, sample.sensorFlags, rec);
+    }
+    memcpy(buf + used, rec, n);
+    used += n;
+    count++;
+    newest = cur;
+}
+
+bool backlogEmpty() {
+    return count == 0;
+}
+
+uint8_t backlogCount() {
+    return count;
+}
+
+size_t backlogBuildBatch(uint8_t* out, uint8_t& taken) {
+    taken = 0;
+    if (count == 0) return 0;
+
+    BatchHeader hdr;
+    hdr.type = MSG_BATCH;
+    hdr.version = PROTOCOL_VERSION_2;
+    hdr.sensorFlags = sensorFlags();
+    hdr.count = 0;
+    hdr.lastSeq = 0;
+
+    uint32_t now = nowSec();
+    TimedSample zero, stored, prevStored, sent, prevSent;
+    memset(&zero, 0, sizeof(zero));
+    prevStored = zero;
+    prevSent = zero;
+    size_t pos = 0;
+    size_t len = sizeof(hdr);
+
+    for (uint8_t i = 0; i < count; i++) {
+        size_t n = decodeSampleDelta(buf + pos, used - pos, prevStored, hdr.sensorFlags, stored);
+        if (n == 0) break;
+        pos += n;
+        prevStored = stored;
+
+        // In the frame, t is the age at send time
+        sent = stored;
+        sent.t = now - stored.t;
+        uint8_t rec[SAMPLE_RECORD_MAX];
+        size_t m = encodeSampleDelta(sent, prevSent, hdr.sensorFlags, rec);
+        if (len + m > BATCH_MAX_FRAME) break;
+        memcpy(out + len, rec, m);
+        len += m;
+        prevSent = sent;
+        hdr.count++;
+        hdr.lastSeq = stored.seq;
+    }
+
+    memcpy(out, &hdr, sizeof(hdr));
+    taken = hdr.count;
+    return len;
+}
+
+void backlogDrop(uint8_t n) {
+    while (n-- > 0 && count > 0) dropOldest();
+}
+
+uint32_t backlogOverflows() {
+    return overflows;
+}
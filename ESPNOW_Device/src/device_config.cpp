@@ -0,0 +1,157 @@
+#include "device_config.h"
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include "serial_link.h" // crc16Ccitt
+
+RTC_DATA_ATTR static RuntimeConfig rtcConfig;
+static bool fsMounted = false;
+
+static uint16_t configCrc(const RuntimeConfig& cfg) {
+    return crc16Ccitt((const uint8_t*)&cfg, offsetof(RuntimeConfig, crc));
+}
+
+static void setDefaults(RuntimeConfig& cfg) {
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.version = RUNTIME_CONFIG_VERSION;
+    cfg.soilMin = 0;    // Dry/Air
+    cfg.soilMax = 4095; // Wet/Water
+    cfg.heartbeatSec = HEARTBEAT_INTERVAL;
+    cfg.dbTemperature = lroundf(DEADBAND_TEMPERATURE * 100);
+    cfg.dbHumidity = lroundf(DEADBAND_HUMIDITY * 10);
+    cfg.dbPressure = lroundf(DEADBAND_PRESSURE * 10);
+    cfg.dbBatteryMv = lroundf(DEADBAND_BATTERY * 1000);
+    cfg.dbLuxPct = DEADBAND_LUX_PCT;
+    cfg.dbSoil = DEADBAND_SOIL;
+    cfg.sleepMinSec = SLEEP_MIN_INTERVAL;
+    cfg.sleepMaxSec = SLEEP_MAX_INTERVAL;
+}
+
+// Scales a user value to fixed point, saturating at [0, hi] instead of wrapping
+static uint16_t toFixed(JsonVariantConst v, float scale, uint16_t hi) {
+    float n = roundf(v.as<float>() * scale);
+    if (!(n > 0)) return 0; // Also NaN
+    return n >= hi ? hi : (uint16_t)n;
+}
+
+// User units (JSON) -> RuntimeConfig fixed point
+static void applyReporting(RuntimeConfig& cfg, JsonVariantConst doc) {
+    if (doc.containsKey("heartbeat")) cfg.heartbeatSec = toFixed(doc["heartbeat"], 1, UINT16_MAX);
+    if (doc.containsKey("temperature")) cfg.dbTemperature = toFixed(doc["temperature"], 100, UINT16_MAX);
+    if (doc.containsKey("humidity")) cfg.dbHumidity = toFixed(doc["humidity"], 10, UINT16_MAX);
+    if (doc.containsKey("pressure")) cfg.dbPressure = toFixed(doc["pressure"], 10, UINT16_MAX);
+    if (doc.containsKey("battery")) cfg.dbBatteryMv = toFixed(doc["battery"], 1000, UINT16_MAX);
+    if (doc.containsKey("lux")) cfg.dbLuxPct = toFixed(doc["lux"], 1, UINT8_MAX);
+    if (doc.containsKey("soil")) cfg.dbSoil = toFixed(doc["soil"], 1, 100);
+}
+
+static void loadFromFlash(RuntimeConfig& cfg) {
+    setDefaults(cfg);
+    if (!mountConfigFs()) return;
+    if (LittleFS.exists("/soil_config.json")) {
+        File f = LittleFS.open("/soil_config.json", "r");
+        if (f) {
+            StaticJsonDocument<64> doc;
+            deserializeJson(doc, f);
+            cfg.soilMin = doc["min"] | 0;
+            cfg.soilMax = doc["max"] | 4095;
+            f.close();
+        }
+    }
+    if (LittleFS.exists("/report_config.json")) {
+        File f = LittleFS.open("/report_config.json", "r");
+        if (f) {
+            StaticJsonDocument<192> doc;
+            if (!deserializeJson(doc, f)) applyReporting(cfg, doc.as<JsonVariantConst>());
+            f.close();
+        }
+    }
+    if (LittleFS.exists("/sleep_config.json")) {
+        File f = LittleFS.open("/sleep_config.json", "r");
+        if (f) {
+            StaticJsonDocument<64> doc;
+            deserializeJson(doc, f);
+            cfg.sleepMinSec = doc["min"] | SLEEP_MIN_INTERVAL;
+            cfg.sleepMaxSec = doc["max"] | SLEEP_MAX_INTERVAL;
+            f.close();
+        }
+    }
+}
+
+bool mountConfigFs() {
+    if (fsMounted) return true;
+    if (!LittleFS.begin(false)) {
+        if (!LittleFS.begin(true)) return false;
+    }
+    fsMounted = true;
+    return true;
+}
+
+bool configBegin() {
+    bool warm = esp_reset_reason() == ESP_RST_DEEPSLEEP;
+    if (warm && rtcConfig.version == RUNTIME_CONFIG_VERSION && rtcConfig.crc == configCrc(rtcConfig)) {
+        return true;
+    }
+    loadFromFlash(rtcConfig);
+    rtcConfig.crc = configCrc(rtcConfig);
+    Serial.println(warm ? "RTC config invalid, reloaded from flash" : "Config loaded from flash (cold boot)");
+    return false;
+}
+
+const RuntimeConfig& runtimeConfig() {
+    return rtcConfig;
+}
+
+void configSaveSoilCalibration(bool isWet, int raw) {
+    loadFromFlash(rtcConfig); // Ensure latest
+    if (isWet) {
+        rtcConfig.soilMax = raw;
+    } else {
+        rtcConfig.soilMin = raw;
+    }
+    rtcConfig.crc = configCrc(rtcConfig);
+
+    File f = LittleFS.open("/soil_config.json", "w");
+    if (f) {
+        StaticJsonDocument<64> doc;
+        doc["min"] = rtcConfig.soilMin;
+        doc["max"] = rtcConfig.soilMax;
+        serializeJson(doc, f);
+        f.close();
+    }
+}
+
+void configSaveReporting(JsonVariantConst settings) {
+    loadFromFlash(rtcConfig); // Ensure latest
+    applyReporting(rtcConfig, settings);
+    rtcConfig.crc = configCrc(rtcConfig);
+
+    File f = LittleFS.open("/report_config.json", "w");
+    if (f) {
+        StaticJsonDocument<192> doc;
+        doc["heartbeat"] = rtcConfig.heartbeatSec;
+        doc["temperature"] = rtcConfig.dbTemperature / 100.0;
+        doc["humidity"] = rtcConfig.dbHumidity / 10.0;
+        doc["pressure"] = rtcConfig.dbPressure / 10.0;
+        doc["battery"] = rtcConfig.dbBatteryMv / 1000.0;
+        doc["lux"] = rtcConfig.dbLuxPct;
+        doc["soil"] = rtcConfig.dbSoil;
+        serializeJson(doc, f);
+        f.close();
+    }
+}
+
+void configSaveSleepBounds(uint16_t minSec, uint16_t maxSec) {
+    loadFromFlash(rtcConfig); // Ensure latest
+    rtcConfig.sleepMinSec = minSec;
+    rtcConfig.sleepMaxSec = maxSec;
+    rtcConfig.crc = configCrc(rtcConfig);
+
+    File f = LittleFS.open("/sleep_config.json", "w");
+    if (f) {
+        StaticJsonDocument<64> doc;
+        doc["min"] = minSec;
+        doc["max"] = maxSec;
+        serializeJson(doc, f);
+        f.close();
+    }
+}
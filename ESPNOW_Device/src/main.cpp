@@ -8,14 +8,20 @@
 
 #include "sensors.h"
 #include "transport.h"
+#include "profiler.h"
+#include "device_config.h"
+#include "report_policy.h"
+#include "sleep_scheduler.h"
+#include "backlog.h"
 #include "CommonUtils.h"
 #include "protocol.h"
 
 #define uS_TO_S_FACTOR 1000000ULL  /* Conversion factor for micro seconds to seconds */
-#define TIME_TO_SLEEP  15          /* Time ESP32 will go to sleep (in seconds) */
+#define BACKLOG_BATCHES_PER_WAKE 4 // Caps the catch-up airtime of a single wake
 
 RTC_DATA_ATTR int bootCount = 0;
 RTC_DATA_ATTR bool isRegistered = false;
+RTC_DATA_ATTR uint16_t dataSeq = 0; // v2 sequence number, survives deep sleep
 
 bool otaMode = false;
 WiFiServer telnetServer(23);
@@ -36,10 +42,9 @@ void saveConfigCallback() {
   shouldSaveConfig = true;
 }
 
+// Only needed on the OTA path, so the filesystem is mounted here and not at every wake
 void loadMqttConfig() {
-  if (!LittleFS.begin(false)) {
-    if (!LittleFS.begin(true)) return;
-  }
+  if (!mountConfigFs()) return;
   loadBaseConfig(mqtt_cfg, "/mqtt_config.json");
 }
 
@@ -109,6 +114,13 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
           delay(100); 
           mqttClient.disconnect();
           ESP.restart();
+      } else if (cmd == "report") {
+          // e.g. {"cmd":"report","temperature":0.5,"lux":10,"heartbeat":600}
+          configSaveReporting(doc.as<JsonVariantConst>());
+          const RuntimeConfig& cfg = runtimeConfig();
+          log("Reporting: heartbeat " + String(cfg.heartbeatSec) + "s, temp " + String(cfg.dbTemperature / 100.0) +
+              ", hum " + String(cfg.dbHumidity / 10.0) + ", pres " + String(cfg.dbPressure / 10.0) +
+              ", lux " + String(cfg.dbLuxPct) + "%, soil " + String(cfg.dbSoil) + ", batt " + String(cfg.dbBatteryMv) + "mV");
       }
   }
 }
@@ -138,6 +150,7 @@ void enterOtaMode() {
     log("Entering OTA Mode...");
     otaMode = true;
     clearOtaRequest();
+    loadMqttConfig();
     
     char portStr[6]; itoa(mqtt_cfg.port, portStr, 10);
     WiFiManagerParameter c_server("server", "MQTT Server", mqtt_cfg.server, 40);
@@ -181,13 +194,40 @@ void enterOtaMode() {
     }
 }
 
+// Uploads the oldest backlog first; returns false if the Gateway stopped ACKing
+bool uploadBacklog() {
+  uint8_t frame[BATCH_MAX_FRAME];
+  for (uint8_t i = 0; i < BACKLOG_BATCHES_PER_WAKE && !backlogEmpty(); i++) {
+    uint8_t taken;
+    size_t len = backlogBuildBatch(frame, taken);
+    if (!sendBatchReliable(frame, len)) return false;
+    backlogDrop(taken);
+  }
+  return true;
+}
+
 void setup() {
+  profilerBegin();
   Serial.begin(115200);
   delay(100);
-  loadMqttConfig();
+  profilerMark(PHASE_SERIAL);
+  configBegin(); // RTC copy; flash only on cold boot
+  profilerMark(PHASE_CONFIG);
   pinMode(8, OUTPUT); digitalWrite(8, HIGH);
   initSensors(); 
-  initTransport();
+  startSensors(); // Conversions run while the radio comes up
+  profilerMark(PHASE_SENSOR_INIT);
+
+  // The radio is only needed when there is something to send. Cold boot and
+  // heartbeat wakes are known up front and bring it up during the conversions;
+  // a change is only known after collectSensors().
+  ReportReason scheduled = reportScheduled();
+  bool radioUp = false;
+  if (scheduled != REPORT_NONE) {
+    initTransport();
+    radioUp = true;
+  }
+  profilerMark(PHASE_RADIO_INIT);
 
   ConfigMessage configMsg;
   memset(&configMsg, 0, sizeof(configMsg));
@@ -208,26 +248,57 @@ void setup() {
   
   WiFi.macAddress(configMsg.macAddr);
   strcpy(configMsg.deviceName, DEVICE_NAME);
-  configMsg.sleepInterval = TIME_TO_SLEEP;
-
-  sendConfigMessage(configMsg);
-  SensorReadings readings = readSensors();
-  
-  DataMessage dataMsg;
-  memset(&dataMsg, 0, sizeof(dataMsg));
-  dataMsg.type = MSG_DATA;
-  dataMsg.sensorFlags = readings.flags;
-  dataMsg.bme = readings.bme;
-  dataMsg.lux = readings.lux;
-  dataMsg.soil = readings.soil;
-  dataMsg.binary = readings.binary;
-
-  sendDataMessage(dataMsg);
+  uint16_t interval = sleepCurrentInterval();
+  configMsg.sleepInterval = interval;
+  configMsg.heartbeatInterval = runtimeConfig().heartbeatSec;
+
+  // CONFIG on cold boot and with every heartbeat keeps discovery current
+  if (scheduled != REPORT_NONE) {
+    sendConfigMessage(configMsg);
+    profilerMark(PHASE_SEND_CONFIG);
+  }
+  SensorReadings readings = collectSensors();
+  profilerMark(PHASE_SENSOR_READ);
   
-  unsigned long waitStart = millis();
-  while (millis() - waitStart < 300) {
-      if (isOtaRequested() || isConfigRequestRequested()) break;
-      delay(10);
+  SensorSample sample;
+  sampleFromReadings(readings.flags, readings.batteryVoltage, readings.bme,
+                     readings.lux, readings.soil, readings.binary, sample);
+
+  ReportReason reason = reportDecide(sample);
+  if (reason != REPORT_NONE) {
+    if (!radioUp) {
+      initTransport();
+      radioUp = true;
+      profilerMark(PHASE_RADIO_INIT);
+    }
+    Serial.printf("Reporting (%s)\n", reportReasonName(reason));
+    // Sleep as soon as the Gateway ACKs; any pending command rides on the ACK.
+    // Readings that do not get through are kept and sent later in order; the
+    // live sample only goes out directly once nothing older is left queued.
+    uint16_t seq = dataSeq++;
+    if (!backlogEmpty()) uploadBacklog();
+    if (backlogEmpty() && sendDataReliable(sample, seq)) reportAcknowledged(sample);
+    else backlogPush(sample, seq);
+    if (!backlogEmpty()) {
+      Serial.printf("Backlog: %u samples, %lu lost\n", backlogCount(), (unsigned long)backlogOverflows());
+    }
+    profilerMark(PHASE_SEND_DATA);
+  }
+
+  uint16_t minSec, maxSec;
+  if (takeSleepBoundsRequest(minSec, maxSec)) configSaveSleepBounds(minSec, maxSec);
+
+  // A new interval is announced before the silence it starts, so exp_aft follows it
+  uint16_t nextInterval = sleepNextInterval(reason, sample.batteryMv);
+  configMsg.sleepInterval = nextInterval;
+  if (nextInterval != interval) {
+    if (!radioUp) {
+      initTransport();
+      radioUp = true;
+    }
+    Serial.printf("Sleep interval %u -> %u s\n", interval, nextInterval);
+    sendConfigMessage(configMsg);
+    waitForSent(30);
   }
 
   if (isConfigRequestRequested()) {
@@ -238,7 +309,15 @@ void setup() {
 
   if (isOtaRequested()) enterOtaMode();
   else {
-    esp_sleep_enable_timer_wakeup(TIME_TO_SLEEP * uS_TO_S_FACTOR);
+    profilerEnd();
+    if (profilerReportDue()) {
+      if (!radioUp) initTransport();
+      ProfileMessage profile;
+      profilerBuildReport(profile);
+      sendProfileMessage(profile);
+    }
+    reportSleeping(nextInterval);
+    esp_sleep_enable_timer_wakeup(nextInterval * uS_TO_S_FACTOR);
     esp_deep_sleep_start();
   }
 }
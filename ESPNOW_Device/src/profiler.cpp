@@ -0,0 +1,74 @@
+#include "profiler.h"
+#include <esp_timer.h>
+
+struct PhaseStats {
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t sumUs;
+    uint16_t runs;  // Wakes in which the phase ran; min/avg/max cover only those
+};
+
+// Zeroed on power-on, kept across deep sleep
+RTC_DATA_ATTR static PhaseStats phaseStats[PHASE_COUNT];
+RTC_DATA_ATTR static uint16_t profiledWakes = 0;
+
+static uint32_t currentUs[PHASE_COUNT];
+static uint32_t ranMask = 0; // Bit per phase marked this wake
+static_assert(PHASE_COUNT <= 32, "ranMask has one bit per phase");
+static int64_t lastMarkUs = 0;
+
+void profilerBegin() {
+    // esp_timer starts at reset, so the first reading is the boot time
+    lastMarkUs = esp_timer_get_time();
+    memset(currentUs, 0, sizeof(currentUs));
+    currentUs[PHASE_BOOT] = (uint32_t)lastMarkUs;
+    ranMask = 1u << PHASE_BOOT;
+}
+
+void profilerMark(ProfilePhase phase) {
+    int64_t now = esp_timer_get_time();
+    currentUs[phase] += (uint32_t)(now - lastMarkUs);
+    ranMask |= 1u << phase;
+    lastMarkUs = now;
+}
+
+void profilerEnd() {
+    currentUs[PHASE_AWAKE] = (uint32_t)esp_timer_get_time();
+    ranMask |= 1u << PHASE_AWAKE;
+    for (uint8_t i = 0; i < PHASE_COUNT; i++) {
+        // A phase skipped this wake (e.g. no radio with nothing to report) is not a 0 µs sample
+        if (!(ranMask & (1u << i))) continue;
+        PhaseStats& s = phaseStats[i];
+        uint32_t us = currentUs[i];
+        if (s.runs == 0 || us < s.minUs) s.minUs = us;
+        if (us > s.maxUs) s.maxUs = us;
+        s.sumUs += us;
+        s.runs++;
+    }
+    profiledWakes++;
+}
+
+bool profilerReportDue() {
+    return profiledWakes >= PROFILE_REPORT_EVERY;
+}
+
+static uint16_t toTicks(uint64_t us) {
+    uint64_t ticks = (us + PROFILE_TICK_US / 2) / PROFILE_TICK_US;
+    return ticks > 0xFFFF ? 0xFFFF : (uint16_t)ticks;
+}
+
+void profilerBuildReport(ProfileMessage& msg) {
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_PROFILE;
+    msg.phaseCount = PHASE_COUNT;
+    msg.wakes = profiledWakes;
+    for (uint8_t i = 0; i < PHASE_COUNT; i++) {
+        const PhaseStats& s = phaseStats[i];
+        if (s.runs == 0) continue; // Did not run in this window: all zero
+        msg.phases[i].minTicks = toTicks(s.minUs);
+        msg.phases[i].avgTicks = toTicks(s.sumUs / s.runs);
+        msg.phases[i].maxTicks = toTicks(s.maxUs);
+    }
+    memset(phaseStats, 0, sizeof(phaseStats));
+    profiledWakes = 0;
+}
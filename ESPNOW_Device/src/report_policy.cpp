@@ -0,0 +1,62 @@
+#include "report_policy.h"
+#include "device_config.h"
+
+#define LUX_DEADBAND_FLOOR 10 // 1 lx, keeps darkness from flapping between 0 and 0.1 lx
+
+// Zeroed on power-on, kept across deep sleep
+RTC_DATA_ATTR static SensorSample lastSent;
+RTC_DATA_ATTR static bool haveLastSent = false;
+RTC_DATA_ATTR static uint32_t secondsSinceSend = 0;
+
+static bool moved(int32_t now, int32_t last, uint32_t deadband) {
+    return (uint32_t)abs(now - last) >= (deadband ? deadband : 1);
+}
+
+static bool outsideDeadband(const SensorSample& s, const RuntimeConfig& cfg) {
+    if (s.sensorFlags != lastSent.sensorFlags) return true;
+    if (moved(s.batteryMv, lastSent.batteryMv, cfg.dbBatteryMv)) return true;
+    if (s.sensorFlags & SENSOR_FLAG_BME) {
+        if (moved(s.temperature, lastSent.temperature, cfg.dbTemperature)) return true;
+        if (moved(s.humidity, lastSent.humidity, cfg.dbHumidity)) return true;
+        if (moved(s.pressure, lastSent.pressure, cfg.dbPressure)) return true;
+    }
+    if (s.sensorFlags & SENSOR_FLAG_LUX) {
+        uint32_t band = (uint32_t)((uint64_t)lastSent.lux * cfg.dbLuxPct / 100);
+        if (band < LUX_DEADBAND_FLOOR) band = LUX_DEADBAND_FLOOR;
+        if (moved(s.lux, lastSent.lux, band)) return true;
+    }
+    if ((s.sensorFlags & SENSOR_FLAG_SOIL) && moved(s.soil, lastSent.soil, cfg.dbSoil)) return true;
+    if ((s.sensorFlags & SENSOR_FLAG_BINARY) && s.binary != lastSent.binary) return true;
+    return false;
+}
+
+ReportReason reportScheduled() {
+    if (!haveLastSent) return REPORT_COLD_BOOT;
+    if (secondsSinceSend >= runtimeConfig().heartbeatSec) return REPORT_HEARTBEAT;
+    return REPORT_NONE;
+}
+
+ReportReason reportDecide(const SensorSample& sample) {
+    ReportReason reason = reportScheduled();
+    if (reason != REPORT_NONE) return reason;
+    return outsideDeadband(sample, runtimeConfig()) ? REPORT_CHANGE : REPORT_NONE;
+}
+
+void reportAcknowledged(const SensorSample& sample) {
+    lastSent = sample;
+    haveLastSent = true;
+    secondsSinceSend = 0;
+}
+
+void reportSleeping(uint32_t seconds) {
+    secondsSinceSend += seconds;
+}
+
+const char* reportReasonName(ReportReason reason) {
+    switch (reason) {
+        case REPORT_COLD_BOOT: return "cold boot";
+        case REPORT_HEARTBEAT: return "heartbeat";
+        case REPORT_CHANGE:    return "change";
+        default:               return "none";
+    }
+}
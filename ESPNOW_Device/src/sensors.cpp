@@ -3,14 +3,14 @@
 #include <Adafruit_Sensor.h>
 #include <Adafruit_BME280.h>
 #include <BH1750.h>
-#include <LittleFS.h>
-#include <ArduinoJson.h>
+#include "device_config.h"
 
 // BME280 and BH1750 use default I2C pins (SDA=D2, SCL=D1 on ESP8266 or similar on ESP32)
 // For ESP32 C3 Mini, verify pins if needed.
 
 #if defined(USE_BME280)
 Adafruit_BME280 bme;
+uint8_t bmeAddr = 0; // 0 = not found
 #endif
 
 #if defined(USE_BH1750)
@@ -33,38 +33,16 @@ BH1750 lightMeter;
     const int BATTERY_PIN = 1; // A0 on C3? Verify.
 #endif
 
+// Acquisition timing (see startSensors()/collectSensors())
+#define SOIL_WARMUP_MS      50
+#define SOIL_SAMPLES        5
+#define SOIL_SAMPLE_GAP_MS  10
+#define SENSOR_TIMEOUT_MS   250 // Give up on a conversion that never completes
 
 
-#if defined(USE_SOIL_SENSOR)
-    struct SoilConfig {
-        int min = 0;   // Dry/Air
-        int max = 4095; // Wet/Water
-    } soilConfig;
-    
-    void loadSoilConfig() {
-        if (LittleFS.exists("/soil_config.json")) {
-            File f = LittleFS.open("/soil_config.json", "r");
-            if (f) {
-                StaticJsonDocument<64> doc;
-                deserializeJson(doc, f);
-                soilConfig.min = doc["min"] | 0;
-                soilConfig.max = doc["max"] | 4095;
-                f.close();
-            }
-        }
-    }
-    
-    void saveSoilConfig() {
-        File f = LittleFS.open("/soil_config.json", "w");
-        if (f) {
-            StaticJsonDocument<64> doc;
-            doc["min"] = soilConfig.min;
-            doc["max"] = soilConfig.max;
-            serializeJson(doc, f);
-            f.close();
-        }
-    }
 
+#if defined(USE_SOIL_SENSOR)
+    // Calibration lives in device_config (RTC cache of /soil_config.json)
     void calibrateSoil(bool isWet) {
         digitalWrite(SOIL_POWER_PIN, HIGH);
         delay(50);
@@ -77,13 +55,7 @@ BH1750 lightMeter;
         digitalWrite(SOIL_POWER_PIN, LOW);
         int avg = sum / 5;
         
-        loadSoilConfig(); // Ensure latest
-        if (isWet) {
-            soilConfig.max = avg;
-        } else {
-            soilConfig.min = avg;
-        }
-        saveSoilConfig();
+        configSaveSoilCalibration(isWet, avg);
     }
 #else
     void calibrateSoil(bool isWet) {}
@@ -91,20 +63,19 @@ BH1750 lightMeter;
 
 void initSensors() {
     Wire.begin();
+    Wire.setClock(400000); // Both sensors support Fast-mode I2C
 
     #if defined(USE_BME280)
         // Initialize BME280
-        if (!bme.begin(0x76)) {
-            if (!bme.begin(0x77)) {
-                Serial.println("Could not find a valid BME280 sensor!");
-            }
-        }
-    #endif
-
-    #if defined(USE_BH1750)
-        // Initialize BH1750
-        if (!lightMeter.begin(BH1750::CONTINUOUS_HIGH_RES_MODE)) {
-            Serial.println("Error initializing BH1750");
+        if (bme.begin(0x76)) bmeAddr = 0x76;
+        else if (bme.begin(0x77)) bmeAddr = 0x77;
+        else Serial.println("Could not find a valid BME280 sensor!");
+
+        // Weather monitoring settings from the datasheet: one forced conversion per wake, ~9 ms
+        if (bmeAddr) {
+            bme.setSampling(Adafruit_BME280::MODE_SLEEP,
+                            Adafruit_BME280::SAMPLING_X1, Adafruit_BME280::SAMPLING_X1,
+                            Adafruit_BME280::SAMPLING_X1, Adafruit_BME280::FILTER_OFF);
         }
     #endif
 
@@ -124,9 +95,66 @@ void initSensors() {
     #endif
 }
 
-SensorReadings readSensors() {
-    SensorReadings readings;
-    memset(&readings, 0, sizeof(readings)); // Zero out
+#if defined(USE_BME280)
+    static void bmeWrite(uint8_t reg, uint8_t value) {
+        Wire.beginTransmission(bmeAddr);
+        Wire.write(reg);
+        Wire.write(value);
+        Wire.endTransmission();
+    }
+
+    static bool bmeMeasuring() {
+        Wire.beginTransmission(bmeAddr);
+        Wire.write(0xF3); // status
+        if (Wire.endTransmission() != 0 || Wire.requestFrom(bmeAddr, (uint8_t)1) != 1) return false;
+        return Wire.read() & 0x08;
+    }
+#endif
+
+#if defined(USE_SOIL_SENSOR)
+    static unsigned long soilPoweredAt = 0;
+    static uint8_t soilTaken = 0;
+    static long soilSum = 0;
+#endif
+
+static SensorReadings pending;
+static unsigned long startedAt = 0;
+
+void startSensors() {
+    memset(&pending, 0, sizeof(pending));
+    startedAt = millis();
+
+    // Slowest first: BH1750 (~120 ms), soil probe warm-up (50 ms + samples), BME280 (~9 ms)
+    #if defined(USE_BH1750)
+        // One-time mode: a single conversion, then the sensor powers down by itself
+        if (!lightMeter.begin(BH1750::ONE_TIME_HIGH_RES_MODE)) {
+            Serial.println("Error initializing BH1750");
+        }
+    #endif
+
+    #if defined(USE_SOIL_SENSOR)
+        digitalWrite(SOIL_POWER_PIN, HIGH);
+        soilPoweredAt = millis();
+        soilTaken = 0;
+        soilSum = 0;
+    #endif
+
+    #if defined(USE_BME280)
+        // ctrl_meas: osrs_t x1, osrs_p x1, forced mode (ctrl_hum was set by setSampling())
+        if (bmeAddr) bmeWrite(0xF4, 0x25);
+    #endif
+
+    #if IS_BATTERY_POWERED
+        int battRaw = analogRead(BATTERY_PIN);
+        // Example divider: (battRaw / 4095.0) * 3.3 * 2
+        pending.batteryVoltage = (battRaw / 4095.0) * 3.3 * 2; 
+    #else
+        pending.batteryVoltage = 0.0;
+    #endif
+}
+
+SensorReadings collectSensors() {
+    SensorReadings& readings = pending;
     readings.flags = 0;
     
     #ifdef USE_BME280
@@ -142,56 +170,75 @@ SensorReadings readSensors() {
         readings.flags |= SENSOR_FLAG_BINARY;
     #endif
     
-    #if IS_BATTERY_POWERED
-        int battRaw = analogRead(BATTERY_PIN);
-        // Example divider: (battRaw / 4095.0) * 3.3 * 2
-        readings.batteryVoltage = (battRaw / 4095.0) * 3.3 * 2; 
-    #else
-        readings.batteryVoltage = 0.0;
+    #if defined(USE_BINARY_SENSOR)
+        readings.binary.state = digitalRead(DOOR_PIN);
     #endif
 
+    // Collect each conversion as soon as it is ready, in whatever order they finish
+    bool bmeDone = true, luxDone = true, soilDone = true;
     #if defined(USE_BME280)
-            readings.bme.temperature = bme.readTemperature();
-            readings.bme.humidity = bme.readHumidity();
-            readings.bme.pressure = bme.readPressure() / 100.0F;
+        bmeDone = false;
     #endif
-
     #if defined(USE_BH1750)
-             readings.lux.lux = lightMeter.readLightLevel();
+        luxDone = false;
     #endif
-
     #if defined(USE_SOIL_SENSOR)
-             // Power up sensor
-             digitalWrite(SOIL_POWER_PIN, HIGH);
-             delay(50); // Warm up
-
-             // Discard first reading
-             analogRead(SOIL_PIN);
-             
-             // Take 5 readings and average
-             long sum = 0;
-             for(int i=0; i<5; i++) {
-                 sum += analogRead(SOIL_PIN);
-                 delay(10);
-             }
-             
-             // Power down
-             digitalWrite(SOIL_POWER_PIN, LOW);
-
-             static bool configLoaded = false;
-             if (!configLoaded) { loadSoilConfig(); configLoaded = true; }
-             
-             int raw = sum / 5;
-             int pct = map(raw, soilConfig.min, soilConfig.max, 0, 100);
-             pct = constrain(pct, 0, 100);
-             readings.soil.moisture = (float)pct; 
-    #endif
-        
-    #if defined(USE_BINARY_SENSOR)
-        readings.binary.state = digitalRead(DOOR_PIN);
+        soilDone = false;
     #endif
 
+    while (!(bmeDone && luxDone && soilDone)) {
+        bool timedOut = millis() - startedAt > SENSOR_TIMEOUT_MS;
+
+        #if defined(USE_BME280)
+            if (!bmeDone && (!bmeAddr || !bmeMeasuring() || timedOut)) {
+                readings.bme.temperature = bmeAddr ? bme.readTemperature() : NAN;
+                readings.bme.humidity = bmeAddr ? bme.readHumidity() : NAN;
+                readings.bme.pressure = bmeAddr ? bme.readPressure() / 100.0F : NAN;
+                bmeDone = true;
+            }
+        #endif
+
+        #if defined(USE_BH1750)
+            if (!luxDone && (lightMeter.measurementReady() || timedOut)) {
+                readings.lux.lux = lightMeter.readLightLevel();
+                luxDone = true;
+            }
+        #endif
+
+        #if defined(USE_SOIL_SENSOR)
+            if (!soilDone) {
+                unsigned long elapsed = millis() - soilPoweredAt;
+                if (soilTaken == 0 && elapsed >= SOIL_WARMUP_MS) {
+                    analogRead(SOIL_PIN); // Discard first reading
+                    soilSum += analogRead(SOIL_PIN);
+                    soilTaken = 1;
+                } else if (soilTaken > 0 && elapsed >= SOIL_WARMUP_MS + soilTaken * SOIL_SAMPLE_GAP_MS) {
+                    soilSum += analogRead(SOIL_PIN);
+                    soilTaken++;
+                }
+                if (soilTaken == SOIL_SAMPLES || timedOut) {
+                    // Power down
+                    digitalWrite(SOIL_POWER_PIN, LOW);
+
+                    const RuntimeConfig& cfg = runtimeConfig();
+                    int raw = soilTaken ? soilSum / soilTaken : 0;
+                    int pct = map(raw, cfg.soilMin, cfg.soilMax, 0, 100);
+                    pct = constrain(pct, 0, 100);
+                    readings.soil.moisture = (float)pct; 
+                    soilDone = true;
+                }
+            }
+        #endif
+
+        if (!(bmeDone && luxDone && soilDone)) delay(1);
+    }
+
     return readings;
 }
 
+SensorReadings readSensors() {
+    startSensors();
+    return collectSensors();
+}
+
 
@@ -0,0 +1,54 @@
+#include "sleep_scheduler.h"
+#include "device_config.h"
+
+// Zeroed on power-on, kept across deep sleep
+RTC_DATA_ATTR static uint16_t currentInterval = 0;
+RTC_DATA_ATTR static uint8_t stableWakes = 0;
+
+// Ladder rungs are min, 2*min, 4*min, ... below max, then max itself, which
+// need not be a power-of-two multiple of min (15..300 ends 120, 240, 300).
+
+// Largest rung <= sec (min if sec is below it)
+static uint16_t ladderFloor(uint32_t sec) {
+    const RuntimeConfig& cfg = runtimeConfig();
+    if (sec >= cfg.sleepMaxSec) return cfg.sleepMaxSec;
+    uint32_t rung = cfg.sleepMinSec ? cfg.sleepMinSec : 1;
+    while (rung * 2 <= sec && rung * 2 < cfg.sleepMaxSec) rung *= 2;
+    return (uint16_t)rung;
+}
+
+// Smallest rung >= sec (max if sec is above it)
+static uint16_t ladderCeil(uint32_t sec) {
+    uint16_t rung = ladderFloor(sec);
+    if (rung >= sec) return rung;
+    uint32_t up = (uint32_t)rung * 2;
+    uint16_t max = runtimeConfig().sleepMaxSec;
+    return up < max ? (uint16_t)up : max;
+}
+
+uint16_t sleepCurrentInterval() {
+    if (currentInterval == 0) currentInterval = runtimeConfig().sleepMinSec;
+    return ladderFloor(currentInterval); // Bounds may have changed
+}
+
+uint16_t sleepNextInterval(ReportReason reason, uint16_t batteryMv) {
+    const RuntimeConfig& cfg = runtimeConfig();
+    uint16_t next = sleepCurrentInterval();
+
+    if (reason == REPORT_CHANGE) {
+        next = next > 1 ? ladderFloor(next - 1) : next; // One rung down
+        stableWakes = 0;
+    } else if (reason == REPORT_NONE && ++stableWakes >= SLEEP_STABLE_WAKES) {
+        next = ladderCeil((uint32_t)next + 1); // One rung up
+        stableWakes = 0;
+    }
+
+    if (batteryMv > 0 && batteryMv < SLEEP_BATTERY_CRITICAL * 1000) {
+        next = cfg.sleepMaxSec;
+    } else if (batteryMv > 0 && batteryMv < SLEEP_BATTERY_LOW * 1000 && next < cfg.sleepMaxSec / 2) {
+        next = ladderCeil(cfg.sleepMaxSec / 2);
+    }
+
+    currentInterval = next;
+    return currentInterval;
+}
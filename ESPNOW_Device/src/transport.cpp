@@ -1,13 +1,116 @@
 #include "transport.h"
+#include <esp_wifi.h>
 
-// Gateway MAC: C4:5b:be:61:86:09
-uint8_t gatewayAddress[] = {0xC4, 0x5B, 0xBE, 0x61, 0x86, 0x09};
+// Gateways are found with a broadcast MSG_PROBE on each candidate channel and
+// kept in RTC memory, ranked by RSSI. A normal wake goes straight to unicast on
+// the cached channel; the next gateway is tried when the active one does not ACK,
+// and the list is rebuilt once the primary has failed GATEWAY_MAX_FAILS wakes in a row.
+// A scan that finds nothing keeps the old list, and the next scan waits 1, 2, 4 ...
+// up to SCAN_BACKOFF_MAX reporting wakes, so an outage does not scan on every wake.
+#define GATEWAY_SLOTS       3
+#define GATEWAY_MAX_FAILS   3
+#define PROBE_CHANNEL_FIRST 1
+#define PROBE_CHANNEL_LAST  13
+// The Gateway answers probes from loop(), not from its receive callback, so a
+// reply can wait behind a busy pass (serial link, MQTT-side traffic). 50 ms per
+// channel covers that and keeps a full scan, done only when the list is rebuilt,
+// well under a second.
+#define PROBE_WAIT_MS       50
+#define SCAN_BACKOFF_MAX    16
+
+struct GatewayInfo {
+    uint8_t mac[6];
+    uint8_t channel;
+    int8_t rssi;   // Measured during discovery
+    uint8_t fails; // Consecutive wakes without an ACK
+};
+
+RTC_DATA_ATTR static GatewayInfo gateways[GATEWAY_SLOTS];
+RTC_DATA_ATTR static uint8_t gatewayCount = 0;
+RTC_DATA_ATTR static bool rescanDue = false;    // Primary stopped answering
+RTC_DATA_ATTR static uint8_t scanBackoff = 0;   // Wakes between scans while none finds a gateway
+RTC_DATA_ATTR static uint8_t scanSkip = 0;      // Wakes left before the next scan
+
+static const uint8_t broadcastAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+uint8_t gatewayAddress[6]; // Active gateway
 
 esp_now_peer_info_t peerInfo;
-static bool otaRequested = false;
-static bool updateRequested = false;
-static bool configRequested = false;
-static bool ackReceived = false;
+// ACK retry policy: a lost frame or ACK is retried after an exponentially
+// growing, jittered pause so that nodes woken together do not collide again.
+// The Gateway ACKs from loop(), which a LittleFS device-store write or the
+// serial link can hold up for tens of ms; the timeout covers that rather
+// than the radio round trip. Retries that still cross a late ACK are dropped
+// by the Gateway (deviceNoteSeq()).
+#define ACK_TIMEOUT_MS      100
+#define ACK_MAX_ATTEMPTS    4
+#define ACK_BACKOFF_BASE_MS 10
+
+static volatile bool otaRequested = false;
+static volatile bool updateRequested = false;
+static volatile bool configRequested = false;
+static volatile bool ackReceived = false;
+static volatile uint16_t ackSeq = 0;
+static volatile bool sleepBoundsRequested = false;
+static volatile uint16_t requestedSleepMin = 0;
+static volatile uint16_t requestedSleepMax = 0;
+static volatile bool sendDone = false;
+
+// Discovery state, filled from the receive callback
+static volatile int8_t lastRssi = 0;
+static uint8_t lastRssiMac[6]; // Sender (802.11 addr2) of the frame lastRssi was measured on
+static volatile bool probing = false;
+static GatewayInfo candidates[GATEWAY_SLOTS];
+static volatile uint8_t candidateCount = 0;
+
+static void handleCommand(uint8_t cmdType, bool value, uint16_t arg0, uint16_t arg1) {
+    switch (cmdType) {
+        case CMD_OTA:
+            otaRequested = value;
+            Serial.printf("CMD: OTA = %s\n", value ? "ON" : "OFF");
+            break;
+            
+        case CMD_RESTART:
+            if (value) {
+                Serial.println("CMD: Restart requested");
+                delay(100);
+                ESP.restart();
+            }
+            break;
+        
+        case CMD_UPDATE:
+            Serial.println("CMD: Force Update requested");
+            otaRequested = false; // Reuse/misuse? No, let's add a new flag
+            // See below for added static bool
+            updateRequested = true; 
+            break;
+        
+        case CMD_CONFIG:
+            Serial.println("CMD: Config resend requested");
+            configRequested = true;
+            break;
+
+        case CMD_SLEEP:
+            // Applied (and stored in flash) from setup(), not from the Wi-Fi task
+            Serial.printf("CMD: Sleep bounds %u-%u s\n", arg0, arg1);
+            requestedSleepMin = arg0;
+            requestedSleepMax = arg1;
+            sleepBoundsRequested = true;
+            break;
+            
+        default:
+            Serial.printf("CMD: Unknown command type %d\n", cmdType);
+            break;
+    }
+}
+
+// Further commands coalesced after an ACK or CMD (see CmdEntry)
+static void handleExtraCommands(const uint8_t* data, int len) {
+    for (; len >= (int)sizeof(CmdEntry); data += sizeof(CmdEntry), len -= sizeof(CmdEntry)) {
+        CmdEntry e;
+        memcpy(&e, data, sizeof(CmdEntry));
+        if (e.cmdType != 0) handleCommand(e.cmdType, e.value, e.arg0, e.arg1);
+    }
+}
 
 void OnDataRecv(const uint8_t * mac, const uint8_t *incomingData, int len) {
     if (len == 0) return;
@@ -15,47 +118,135 @@ void OnDataRecv(const uint8_t * mac, const uint8_t *incomingData, int len) {
     uint8_t msgType = incomingData[0];
     
     if (msgType == MSG_ACK && len >= sizeof(AckMessage)) {
-        Serial.println("ACK received");
+        AckMessage ack;
+        memcpy(&ack, incomingData, sizeof(AckMessage));
+        Serial.printf("ACK received #%u\n", ack.seq);
+        // Apply the piggybacked command before signalling, so the caller sees it on wake-up
+        if (ack.cmdType != 0) handleCommand(ack.cmdType, ack.value, ack.arg0, ack.arg1);
+        handleExtraCommands(incomingData + sizeof(AckMessage), len - sizeof(AckMessage));
+        ackSeq = ack.seq;
         ackReceived = true;
     }
-    else if (msgType == MSG_CMD && len >= sizeof(CmdMessage)) {
+    else if (msgType == MSG_CMD && len >= CMD_MESSAGE_V1_SIZE) {
         CmdMessage cmd;
-        memcpy(&cmd, incomingData, sizeof(CmdMessage));
-        
-        switch (cmd.cmdType) {
-            case CMD_OTA:
-                otaRequested = cmd.value;
-                Serial.printf("CMD: OTA = %s\n", cmd.value ? "ON" : "OFF");
-                break;
-                
-            case CMD_RESTART:
-                if (cmd.value) {
-                    Serial.println("CMD: Restart requested");
-                    delay(100);
-                    ESP.restart();
-                }
-                break;
-            
-            case CMD_UPDATE:
-                Serial.println("CMD: Force Update requested");
-                otaRequested = false; // Reuse/misuse? No, let's add a new flag
-                // See below for added static bool
-                updateRequested = true; 
-                break;
-            
-            case CMD_CONFIG:
-                Serial.println("CMD: Config resend requested");
-                configRequested = true;
-                break;
-                
-            default:
-                Serial.printf("CMD: Unknown command type %d\n", cmd.cmdType);
-                break;
+        memset(&cmd, 0, sizeof(cmd));
+        memcpy(&cmd, incomingData, len < (int)sizeof(CmdMessage) ? len : sizeof(CmdMessage));
+        handleCommand(cmd.cmdType, cmd.value, cmd.arg0, cmd.arg1);
+        if (len > (int)sizeof(CmdMessage)) handleExtraCommands(incomingData + sizeof(CmdMessage), len - sizeof(CmdMessage));
+    }
+    else if (msgType == MSG_PROBE_REPLY && len >= sizeof(ProbeReplyMessage) && probing) {
+        ProbeReplyMessage reply;
+        memcpy(&reply, incomingData, sizeof(ProbeReplyMessage));
+        // Only trust the sniffed RSSI if it was measured on this gateway's frame;
+        // otherwise rank the reply last rather than with another sender's signal
+        int8_t rssi = memcmp(lastRssiMac, mac, 6) == 0 ? lastRssi : INT8_MIN;
+        // Keep the strongest GATEWAY_SLOTS replies
+        uint8_t slot = candidateCount;
+        if (slot == GATEWAY_SLOTS) {
+            slot = 0;
+            for (uint8_t i = 1; i < GATEWAY_SLOTS; i++) {
+                if (candidates[i].rssi < candidates[slot].rssi) slot = i;
+            }
+            if (candidates[slot].rssi >= rssi) return;
+        } else {
+            candidateCount++;
+        }
+        memcpy(candidates[slot].mac, mac, 6);
+        candidates[slot].channel = reply.channel;
+        candidates[slot].rssi = rssi;
+        candidates[slot].fails = 0;
+    }
+}
+
+// RSSI is not passed to the ESP-NOW receive callback; sniff it from the
+// management frame (ESP-NOW uses vendor action frames) while probing.
+// Both callbacks run in the WiFi task, this one first for the same frame.
+static void promiscuousRx(void* buf, wifi_promiscuous_pkt_type_t type) {
+    const wifi_promiscuous_pkt_t* pkt = (const wifi_promiscuous_pkt_t*)buf;
+    // Frame control (2), duration (2), addr1 (6), addr2 (6)
+    if (type != WIFI_PKT_MGMT || pkt->rx_ctrl.sig_len < 16) return;
+    memcpy(lastRssiMac, pkt->payload + 10, 6);
+    lastRssi = pkt->rx_ctrl.rssi;
+}
+
+static bool setPeer(const uint8_t* mac, uint8_t channel) {
+    esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+    if (esp_now_is_peer_exist(mac)) esp_now_del_peer(mac);
+    memset(&peerInfo, 0, sizeof(peerInfo));
+    memcpy(peerInfo.peer_addr, mac, 6);
+    peerInfo.channel = channel;
+    peerInfo.encrypt = false;
+    return esp_now_add_peer(&peerInfo) == ESP_OK;
+}
+
+static void selectGateway(uint8_t index) {
+    memcpy(gatewayAddress, gateways[index].mac, 6);
+    if (!setPeer(gatewayAddress, gateways[index].channel)) {
+        Serial.println("Failed to add peer");
+    }
+}
+
+// Moves gateways[index] to the front, keeping the order of the others
+static void promoteGateway(uint8_t index) {
+    GatewayInfo g = gateways[index];
+    memmove(&gateways[1], &gateways[0], index * sizeof(GatewayInfo));
+    gateways[0] = g;
+}
+
+static bool discoverGateways() {
+    Serial.println("Discovering gateways...");
+    candidateCount = 0;
+    memset(lastRssiMac, 0, sizeof(lastRssiMac));
+    probing = true;
+
+    wifi_promiscuous_filter_t filter = { .filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT };
+    esp_wifi_set_promiscuous_filter(&filter);
+    esp_wifi_set_promiscuous_rx_cb(promiscuousRx);
+    esp_wifi_set_promiscuous(true);
+
+    for (uint8_t ch = PROBE_CHANNEL_FIRST; ch <= PROBE_CHANNEL_LAST; ch++) {
+        setPeer(broadcastAddress, ch);
+        ProbeMessage probe = { MSG_PROBE, ch };
+        esp_now_send(broadcastAddress, (uint8_t *) &probe, sizeof(probe));
+        delay(PROBE_WAIT_MS);
+    }
+
+    esp_wifi_set_promiscuous(false);
+    esp_now_del_peer(broadcastAddress);
+    probing = false;
+
+    uint8_t count = candidateCount;
+    if (count == 0) {
+        // Keep whatever list there is and back off
+        scanBackoff = scanBackoff == 0 ? 1 : scanBackoff * 2 > SCAN_BACKOFF_MAX ? SCAN_BACKOFF_MAX : scanBackoff * 2;
+        scanSkip = scanBackoff;
+        Serial.printf("No gateway found, next scan in %u wakes\n", scanBackoff);
+        return false;
+    }
+    rescanDue = false;
+    scanBackoff = scanSkip = 0;
+
+    // Rank by RSSI, strongest first
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t best = i;
+        for (uint8_t j = i + 1; j < count; j++) {
+            if (candidates[j].rssi > candidates[best].rssi) best = j;
         }
+        gateways[i] = candidates[best];
+        candidates[best] = candidates[i];
     }
+    gatewayCount = count;
+
+    for (uint8_t i = 0; i < gatewayCount; i++) {
+        const GatewayInfo& g = gateways[i];
+        Serial.printf("Gateway %u: %02X:%02X:%02X:%02X:%02X:%02X ch %u rssi %d\n", i,
+                      g.mac[0], g.mac[1], g.mac[2], g.mac[3], g.mac[4], g.mac[5], g.channel, g.rssi);
+    }
+    return true;
 }
 
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
+  sendDone = true;
   if (status == ESP_NOW_SEND_SUCCESS) {
     Serial.println("Send Status: Success");
   } else {
@@ -74,18 +265,17 @@ void initTransport() {
     esp_now_register_send_cb(OnDataSent);
     esp_now_register_recv_cb(OnDataRecv);
 
-    // Register peer
-    memcpy(peerInfo.peer_addr, gatewayAddress, 6);
-    peerInfo.channel = 1;  
-    peerInfo.encrypt = false;
-    
-    if (esp_now_add_peer(&peerInfo) != ESP_OK){
-        Serial.println("Failed to add peer");
-        return;
+    // Cached gateway: single unicast, no scan
+    if (gatewayCount == 0 || rescanDue) {
+        if (scanSkip > 0) scanSkip--;
+        else discoverGateways();
     }
+    if (gatewayCount == 0) return;
+    selectGateway(0);
 }
 
 bool sendConfigMessage(ConfigMessage msg) {
+    sendDone = false;
     esp_err_t result = esp_now_send(gatewayAddress, (uint8_t *) &msg, sizeof(msg));
     
     if (result == ESP_OK) {
@@ -97,16 +287,78 @@ bool sendConfigMessage(ConfigMessage msg) {
     }
 }
 
-bool sendDataMessage(DataMessage msg) {
-    esp_err_t result = esp_now_send(gatewayAddress, (uint8_t *) &msg, sizeof(msg));
-    
-    if (result == ESP_OK) {
-        Serial.println("Sent Data Message");
-        return true;
-    } else {
-        Serial.println("Error sending Data Message");
+static bool sendFrameWithRetry(const uint8_t* frame, size_t len, uint16_t seq) {
+    for (uint8_t attempt = 0; attempt < ACK_MAX_ATTEMPTS; attempt++) {
+        if (attempt > 0) {
+            uint32_t backoff = (uint32_t)ACK_BACKOFF_BASE_MS << (attempt - 1);
+            delay(backoff + esp_random() % backoff);
+        }
+        clearAckFlag();
+        if (esp_now_send(gatewayAddress, frame, len) == ESP_OK && waitForAck(seq, ACK_TIMEOUT_MS)) {
+            if (attempt > 0) Serial.printf("Frame #%u delivered after %u retries\n", seq, attempt);
+            return true;
+        }
+    }
+    Serial.printf("Frame #%u not acknowledged after %u attempts\n", seq, ACK_MAX_ATTEMPTS);
+    return false;
+}
+
+// Sends an ACKed frame (DATA or BATCH), failing over through the cached gateways
+static bool sendFrameReliable(const uint8_t* frame, size_t len, uint16_t seq) {
+    for (uint8_t g = 0; g < gatewayCount; g++) {
+        if (g > 0) {
+            Serial.printf("Failing over to gateway %u\n", g);
+            selectGateway(g);
+        }
+        if (sendFrameWithRetry(frame, len, seq)) {
+            gateways[g].fails = 0;
+            rescanDue = false;
+            scanBackoff = scanSkip = 0;
+            if (g > 0) promoteGateway(g);
+            return true;
+        }
+        if (gateways[g].fails < 0xFF) gateways[g].fails++;
+    }
+    // Primary keeps failing: rescan on the next wake, keeping this list until one answers
+    if (gatewayCount > 0 && gateways[0].fails >= GATEWAY_MAX_FAILS && !rescanDue) {
+        Serial.println("Gateway unreachable, rediscovering on next wake");
+        rescanDue = true;
+    }
+    return false;
+}
+
+bool sendDataReliable(const SensorSample& sample, uint16_t seq) {
+    uint8_t buf[DATA_V2_MAX_SIZE];
+    size_t len = encodeDataV2(sample, seq, buf);
+    Serial.printf("Sending Data v2 #%u (%u bytes)\n", seq, (unsigned)len);
+    return sendFrameReliable(buf, len, seq);
+}
+
+bool sendBatchReliable(const uint8_t* frame, size_t len) {
+    BatchHeader hdr;
+    memcpy(&hdr, frame, sizeof(hdr));
+    Serial.printf("Sending backlog batch of %u (%u bytes)\n", hdr.count, (unsigned)len);
+    return sendFrameReliable(frame, len, hdr.lastSeq);
+}
+
+bool sendProfileMessage(const ProfileMessage& msg) {
+    size_t len = offsetof(ProfileMessage, phases) + msg.phaseCount * sizeof(PhaseSummary);
+    sendDone = false;
+    esp_err_t result = esp_now_send(gatewayAddress, (const uint8_t *) &msg, len);
+    if (result != ESP_OK) {
+        Serial.println("Error sending Profile Message");
         return false;
     }
+    // Not acknowledged: just make sure it is on air before deep sleep
+    waitForSent(ACK_TIMEOUT_MS);
+    Serial.println("Sent Profile Message");
+    return true;
+}
+
+bool waitForSent(uint32_t timeoutMs) {
+    unsigned long start = millis();
+    while (!sendDone && millis() - start < timeoutMs) delay(1);
+    return sendDone;
 }
 
 bool isOtaRequested() {
@@ -140,3 +392,20 @@ bool hasAckBeenReceived() {
 void clearAckFlag() {
     ackReceived = false;
 }
+
+bool takeSleepBoundsRequest(uint16_t& minSec, uint16_t& maxSec) {
+    if (!sleepBoundsRequested) return false;
+    minSec = requestedSleepMin;
+    maxSec = requestedSleepMax;
+    sleepBoundsRequested = false;
+    return true;
+}
+
+bool waitForAck(uint16_t seq, uint32_t timeoutMs) {
+    unsigned long start = millis();
+    while (millis() - start < timeoutMs) {
+        if (ackReceived && ackSeq == seq) return true;
+        delay(1);
+    }
+    return false;
+}
@@ -2,16 +2,21 @@
 #include <ESP8266WiFi.h>
 #include <espnow.h>
 #include <ArduinoJson.h>
-#include <SoftwareSerial.h>
 #include <ArduinoOTA.h>
 #include <WiFiManager.h>
 #include <LittleFS.h>
-#include <map>
-#include <vector>
-#include <vector>
 
+#include "link_port.h"
 #include "CommonUtils.h"
 #include "protocol.h"
+#include "protocol_v2.h"
+#include "serial_link.h"
+#include "spsc_ring.h"
+#include "device_registry.h"
+#include "device_store.h"
+#include "command_mailbox.h"
+#include "peer_cache.h"
+#include "link_queue.h"
 
 // Forward declarations or early declarations
 bool otaMode = false;
@@ -21,176 +26,462 @@ bool isOTAUpdating = false;
 bool otaStatusSent = false;
 
 // Global log helper
-void log(const String& msg, bool newline = true) {
+void log(const char* msg, bool newline = true) {
     logToBoth(msg, newline, telnetClient);
 }
 
-// Device tracking maps
-std::map<String, String> deviceNames;
-std::map<String, std::vector<uint8_t>> deviceMacs;
-std::map<String, bool> stayAwakeState;
+void log(const String& msg, bool newline = true) {
+    log(msg.c_str(), newline);
+}
 
-void loadKnownDevices() {
-    if (LittleFS.exists("/known_devices.json")) {
-        File f = LittleFS.open("/known_devices.json", "r");
-        if (f) {
-            StaticJsonDocument<1024> doc;
-            DeserializationError error = deserializeJson(doc, f);
-            if (!error) {
-                JsonObject obj = doc.as<JsonObject>();
-                for (JsonPair kv : obj) {
-                    deviceNames[kv.key().c_str()] = kv.value().as<String>();
-                }
-                Serial.println("Loaded known devices from LittleFS");
-            }
+// printf-style log for the per-packet paths: formats on the stack, no String temporaries
+void logPrintf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+void logPrintf(const char* fmt, ...) {
+    char line[128];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    log(line);
+}
+
+// Device tracking: MAC -> name/slug, no heap on lookup
+const uint16_t MAX_DEVICES = 64;
+static_assert(MAX_DEVICES <= LINK_MAX_DEVICE_ID, "Registry index + 1 is the device id on the link");
+DeviceRegistry<MAX_DEVICES> registry;
+
+// Commands for sleeping devices, delivered after their next uplink
+const uint8_t MAILBOX_SLOTS = 32;
+const uint32_t MAILBOX_DEFAULT_TTL_S = 3600;
+const uint32_t MAILBOX_MAX_TTL_S = 7 * 24 * 3600;
+CommandMailbox<MAILBOX_SLOTS, DOWNLINK_MAX_CMDS> mailbox;
+
+// Known devices: append-only log of DeviceRecords (see device_store.h)
+#define DEVICE_LOG_PATH     "/devices.log"
+#define DEVICE_LOG_TMP_PATH "/devices.tmp"
+#define LEGACY_DEVICES_PATH "/known_devices.json"
+uint32_t deviceLogRecords = 0;
+
+// Rewrites the log with one record per device, swapped in with an atomic rename
+void compactDevices() {
+    File f = LittleFS.open(DEVICE_LOG_TMP_PATH, "w");
+    if (!f) return;
+    for (uint16_t i = 0; i < registry.size(); i++) {
+        DeviceRecord r;
+        deviceRecordFrom(registry.at(i), r);
+        if (f.write((const uint8_t*)&r, sizeof(r)) != sizeof(r)) {
             f.close();
+            LittleFS.remove(DEVICE_LOG_TMP_PATH);
+            return;
+        }
+    }
+    f.close();
+    if (!LittleFS.rename(DEVICE_LOG_TMP_PATH, DEVICE_LOG_PATH)) return;
+    for (uint16_t i = 0; i < registry.size(); i++) registry.at(i).flags |= DEVICE_FLAG_SAVED;
+    deviceLogRecords = registry.size();
+    LOG_SERIAL.printf("Compacted device log to %u records\n", (unsigned)deviceLogRecords);
+}
+
+// Imports the JSON store written by older firmware
+void importLegacyDevices() {
+    File f = LittleFS.open(LEGACY_DEVICES_PATH, "r");
+    if (!f) return;
+    StaticJsonDocument<1024> doc;
+    DeserializationError error = deserializeJson(doc, f);
+    f.close();
+    if (!error) {
+        for (JsonPair kv : doc.as<JsonObject>()) {
+            uint8_t mac[6];
+            if (parseMac(kv.key().c_str(), mac)) registry.upsert(mac, kv.value().as<const char*>());
+        }
+    }
+    compactDevices();
+    if (deviceLogRecords == registry.size()) LittleFS.remove(LEGACY_DEVICES_PATH);
+    LOG_SERIAL.printf("Imported %u devices from %s\n", registry.size(), LEGACY_DEVICES_PATH);
+}
+
+void loadKnownDevices() {
+    LittleFS.remove(DEVICE_LOG_TMP_PATH); // Left over from an interrupted compaction
+    File f = LittleFS.open(DEVICE_LOG_PATH, "r");
+    if (!f) {
+        importLegacyDevices();
+        return;
+    }
+    uint32_t start = micros();
+    size_t valid = deviceLogReplay(f, registry, deviceLogRecords);
+    size_t size = f.size();
+    f.close();
+    LOG_SERIAL.printf("Loaded %u devices from %u log records in %lu us\n", registry.size(),
+                  (unsigned)deviceLogRecords, (unsigned long)(micros() - start));
+    if (valid < size) {
+        // Torn append (power loss): drop the partial record so new ones line up
+        File t = LittleFS.open(DEVICE_LOG_PATH, "r+");
+        if (t) {
+            t.truncate(valid);
+            t.close();
         }
+        LOG_SERIAL.printf("Device log truncated from %u to %u bytes\n", (unsigned)size, (unsigned)valid);
     }
 }
 
-void saveKnownDevices() {
-    File f = LittleFS.open("/known_devices.json", "w");
-    if (f) {
-        StaticJsonDocument<1024> doc;
-        for (auto const& [mac, name] : deviceNames) {
-            doc[mac] = name;
+// Appends one record for a new, renamed or reconfigured device
+bool appendDevice(DeviceEntry& e) {
+    File f = LittleFS.open(DEVICE_LOG_PATH, "a");
+    if (!f) return false;
+    DeviceRecord r;
+    deviceRecordFrom(e, r);
+    bool ok = f.write((const uint8_t*)&r, sizeof(r)) == sizeof(r);
+    f.close();
+    if (!ok) return false;
+    e.flags |= DEVICE_FLAG_SAVED;
+    deviceLogRecords++;
+    return true;
+}
+
+// Persists at most one unsaved device per call, compacting once the log has
+// grown to twice the registry. Called from loop() when no packets are waiting.
+void persistDevices() {
+    if (deviceLogRecords > 2 * (uint32_t)registry.size() + 16) {
+        compactDevices();
+        return;
+    }
+    for (uint16_t i = 0; i < registry.size(); i++) {
+        DeviceEntry& e = registry.at(i);
+        if (!(e.flags & DEVICE_FLAG_SAVED)) {
+            appendDevice(e);
+            return;
         }
-        serializeJson(doc, f);
-        f.close();
-        Serial.println("Saved known devices to LittleFS");
     }
 }
 
+void forgetKnownDevices() {
+    registry.clear();
+    LittleFS.remove(DEVICE_LOG_PATH);
+    deviceLogRecords = 0;
+}
+
 void processCommand(String line); // Forward declaration
 
-SoftwareSerial swSerial(D6, D5); // RX = D6, TX = D5
 
-// --- Buffer Implementation ---
-struct QueueItem {
+// --- Link to the Transmitter ---
+// Frames wait in linkQueue until the Transmitter acknowledges them and are only
+// sent against its credit (see serial_link.h). While it is busy or restarting,
+// up to 8 KB (a few hundred readings) is held here, oldest dropped first.
+const uint32_t LINK_QUEUE_SIZE = 8192;
+const unsigned long LINK_RETRY_MIN_MS = 1000;
+const unsigned long LINK_RETRY_MAX_MS = 30000;
+LinkQueue<LINK_QUEUE_SIZE> linkQueue;
+uint16_t linkWindow = 0;          // Frames the Transmitter accepts past the last ack, 0 until it grants
+bool linkSyncPending = true;      // Announce our numbering (boot, or the Transmitter lost track)
+bool linkAnnouncePending = false; // Restarted Transmitter: resend every device id ahead of the SYNC
+bool linkDirectoryQueued = false; // Those announces are still unacknowledged, up to linkDirectoryEnd
+uint16_t linkDirectoryEnd = 0;
+unsigned long linkLastProgress = 0;
+unsigned long linkRetryMs = LINK_RETRY_MIN_MS;
+uint32_t linkRetransmits = 0;
+
+// Queues a JSON status line for the Transmitter as a LINK_FRAME_JSON frame
+void sendLinkJson(const String& json) {
+    linkQueue.push(LINK_FRAME_JSON, json.c_str(), json.length());
+}
+
+uint16_t deviceId(const DeviceEntry* dev) {
+    return dev ? registry.indexOf(dev) + 1 : 0;
+}
+
+// LINK_FRAME_DEVICE payload: the id -> (MAC, name) mapping the Transmitter
+// needs before it can handle a record with that id
+size_t buildAnnounce(const DeviceEntry& e, uint8_t* payload) {
     uint8_t mac[6];
-    uint8_t data[250];
-    uint8_t len;
-};
+    keyToMac(e.mac, mac);
+    return linkBuildDevice(deviceId(&e), mac, e.name, payload);
+}
+
+void announceDevice(DeviceEntry& e) {
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    linkQueue.push(LINK_FRAME_DEVICE, payload, buildAnnounce(e, payload));
+    e.flags |= DEVICE_FLAG_ANNOUNCED;
+}
+
+// Keeps room in linkQueue for a full set of announces, so announceAllDevices()
+// fits however much backlog is queued. Called whenever a device may be new or renamed.
+void updateLinkReserve() {
+    uint32_t bytes = 0;
+    for (uint16_t i = 0; i < registry.size(); i++) {
+        bytes += linkQueue.HEADER_SIZE + 9 + strlen(registry.at(i).name);
+    }
+    linkQueue.setReserve(bytes);
+}
+
+// Puts every id ahead of the queued frames, for a Transmitter that has lost
+// them or meets a record it cannot resolve.
+void announceAllDevices() {
+    for (uint16_t i = 0; i < registry.size(); i++) registry.at(i).flags &= ~DEVICE_FLAG_ANNOUNCED;
+    uint16_t last = linkQueue.firstSeq() - 1;
+    for (uint16_t i = registry.size(); i-- > 0;) {
+        DeviceEntry& e = registry.at(i);
+        uint8_t payload[LINK_MAX_PAYLOAD];
+        if (!linkQueue.pushFront(LINK_FRAME_DEVICE, payload, buildAnnounce(e, payload))) break;
+        e.flags |= DEVICE_FLAG_ANNOUNCED;
+        linkDirectoryQueued = true;
+        linkDirectoryEnd = last;
+    }
+}
+
+// Applies a credit line from the Transmitter:
+// {"link":"credit","ack":N,"win":W[,"resend":true][,"announce":true]}
+// "announce" means the next frame is a record whose id it does not know; it is
+// left unacknowledged, so announcing every device ahead of it and syncing
+// there delivers it again.
+void handleLinkCredit(JsonDocument& doc) {
+    linkWindow = doc["win"] | 0;
+    uint16_t before = linkQueue.lastAcked();
+    if (!doc.containsKey("ack")) {
+        // Restarted Transmitter: it knows no device ids yet (unless they are still queued from its last restart)
+        linkSyncPending = true;
+        linkAnnouncePending = !linkDirectoryQueued;
+        return;
+    }
+    if (!linkQueue.ack(doc["ack"].as<uint16_t>())) {
+        // Waiting for frames we have dropped
+        linkSyncPending = true;
+        return;
+    }
+    if (linkDirectoryQueued && (int16_t)(linkQueue.lastAcked() - linkDirectoryEnd) >= 0) linkDirectoryQueued = false;
+    if (doc["announce"] == true) {
+        // Unknown id in the next frame; a directory still queued ahead of it will do
+        linkSyncPending = true;
+        linkAnnouncePending = !linkDirectoryQueued;
+        return;
+    }
+    if (doc["resend"] == true) linkQueue.rewind();
+    if (linkQueue.lastAcked() != before || linkQueue.inFlight() == 0) {
+        linkLastProgress = millis();
+        linkRetryMs = LINK_RETRY_MIN_MS;
+    }
+}
 
-const int BUFFER_SIZE = 32;
-QueueItem msgBuffer[BUFFER_SIZE];
-volatile int head = 0;
-volatile int tail = 0;
-
-void enqueueMessage(const uint8_t* mac, const uint8_t* data, uint8_t len) {
-    int nextHead = (head + 1) % BUFFER_SIZE;
-    if (nextHead != tail) {
-        memcpy(msgBuffer[head].mac, mac, 6);
-        memcpy(msgBuffer[head].data, data, len);
-        msgBuffer[head].len = len;
-        head = nextHead;
+void writeLinkFrame(uint8_t frameType, uint16_t seq, const uint8_t* payload, size_t len) {
+    uint8_t frame[LINK_MAX_ENCODED];
+    size_t n = linkEncodeFrame(frameType, seq, payload, len, frame, sizeof(frame));
+    if (n > 0) linkSerial.write(frame, n);
+}
+
+// Sends queued frames while the Transmitter has credit; retransmits on silence
+void serviceLink() {
+    if (linkSyncPending) {
+        linkQueue.rewind();
+        if (linkAnnouncePending) announceAllDevices();
+        writeLinkFrame(LINK_FRAME_SYNC, linkQueue.firstSeq(), nullptr, 0);
+        linkSyncPending = false;
+        linkAnnouncePending = false;
+        linkLastProgress = millis();
+    }
+    if (linkQueue.inFlight() > 0 && millis() - linkLastProgress > linkRetryMs) {
+        // No acknowledgement: go back to the oldest unacknowledged frame, backing off
+        linkQueue.rewind();
+        linkRetransmits++;
+        linkLastProgress = millis();
+        linkRetryMs = min(linkRetryMs * 2, LINK_RETRY_MAX_MS);
+    }
+    while (linkQueue.hasUnsent() && linkQueue.inFlight() < linkWindow) {
+        uint8_t payload[LINK_MAX_PAYLOAD];
+        uint8_t frameType;
+        uint16_t seq;
+        uint16_t len = linkQueue.next(frameType, seq, payload, sizeof(payload));
+        if (linkQueue.inFlight() == 1) linkLastProgress = millis();
+        writeLinkFrame(frameType, seq, payload, len);
     }
 }
 
+// --- Buffer Implementation ---
+// The ESP-NOW callbacks run in the Wi-Fi task and only copy into these rings;
+// everything else (registry, replies, peers, serial) happens in loop().
+// Received records are [RxHeader][packet]: a 20-42 byte packet only costs its
+// own size plus 12 bytes, so bursts queue many more packets than fixed slots.
+const uint32_t RX_RING_SIZE = 4096; // Drained every loop() pass; backlog for the Transmitter waits in linkQueue
+SpscByteRing<RX_RING_SIZE, RING_DROP_OLDEST> rxRing;
+
+struct __attribute__((packed)) RxHeader {
+    uint8_t mac[6];
+    uint32_t rxUs;  // micros() at reception, for the queueing delay
+};
+
+// Send results, [mac 6][status 1]
+SpscByteRing<256> txRing;
+
+// Callback instrumentation, reported in the heartbeat
+volatile uint32_t rxCallbackMaxUs = 0;
+uint32_t rxDelayMaxUs = 0; // Worst reception-to-processing delay since the last heartbeat
+
 void onDataRecv(uint8_t * mac, uint8_t *incomingData, uint8_t len) {
+    uint32_t start = micros();
     if (len == 0 || len > 250) return;
-    uint8_t type = incomingData[0];
-    char macStr[18];
-    snprintf(macStr, sizeof(macStr), "%02X:%02X:%02X:%02X:%02X:%02X", 
-             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-
-    if (type == MSG_CONFIG && len >= sizeof(ConfigMessage)) {
-        ConfigMessage config;
-        memcpy(&config, incomingData, sizeof(ConfigMessage));
-        String devName = String(config.deviceName);
-        deviceNames[macStr] = devName;
-        std::vector<uint8_t> macVec(mac, mac + 6);
-        deviceMacs[devName] = macVec;
-
-        if (stayAwakeState.count(devName) && stayAwakeState[devName]) {
-            CmdMessage cmd;
-            cmd.type = MSG_CMD;
-            cmd.cmdType = CMD_OTA;
-            cmd.value = true;
-            esp_now_add_peer(mac, ESP_NOW_ROLE_COMBO, 1, NULL, 0);
-            esp_now_send(mac, (uint8_t *)&cmd, sizeof(CmdMessage));
-            stayAwakeState[devName] = false; 
+    RxHeader hdr;
+    memcpy(hdr.mac, mac, 6);
+    hdr.rxUs = start;
+    rxRing.push(&hdr, sizeof(hdr), incomingData, len);
+    uint32_t took = micros() - start;
+    if (took > rxCallbackMaxUs) rxCallbackMaxUs = took;
+}
+
+void onDataSent(uint8_t* mac, uint8_t status) {
+    txRing.push(mac, 6, &status, 1);
+}
+
+// The SDK peer table holds about 20 entries and every unicast needs one, so
+// only the most recently used devices stay registered (a few slots are left spare)
+bool addRadioPeer(const uint8_t* mac, uint8_t channel) {
+    return esp_now_add_peer((uint8_t*)mac, ESP_NOW_ROLE_COMBO, channel, NULL, 0) == 0;
+}
+
+void delRadioPeer(const uint8_t* mac) {
+    esp_now_del_peer((uint8_t*)mac);
+}
+
+const uint8_t PEER_SLOTS = 16;
+PeerCache<PEER_SLOTS> peers(addRadioPeer, delRadioPeer);
+
+/**
+ * Sends the device's queued commands in one frame: as the ACK of a DATA/BATCH
+ * uplink (always sent), or as a MSG_CMD after CONFIG (only if there is any).
+ * The first command fills the message's own fields, the rest follow as CmdEntry.
+ */
+void sendDownlink(uint8_t* mac, const DeviceEntry* dev, bool isAck, uint16_t seq) {
+    MailItem mail[DOWNLINK_MAX_CMDS];
+    uint8_t count = dev ? mailbox.take(registry.indexOf(dev), mail, DOWNLINK_MAX_CMDS, millis(), CMD_RESTART) : 0;
+    if (count == 0 && !isAck) return;
+
+    uint8_t frame[sizeof(AckMessage) + (DOWNLINK_MAX_CMDS - 1) * sizeof(CmdEntry)];
+    size_t header = isAck ? offsetof(AckMessage, cmdType) : offsetof(CmdMessage, cmdType);
+    frame[0] = isAck ? MSG_ACK : MSG_CMD;
+    if (isAck) memcpy(frame + 1, &seq, sizeof(seq));
+    size_t len = header;
+    for (uint8_t i = 0; i < count || len == header; i++) {
+        CmdEntry e;
+        memset(&e, 0, sizeof(e));
+        if (i < count) {
+            e.cmdType = mail[i].cmdType;
+            e.value = mail[i].value;
+            e.arg0 = mail[i].arg0;
+            e.arg1 = mail[i].arg1;
         }
+        memcpy(frame + len, &e, sizeof(e));
+        len += sizeof(e);
     }
-    
-    if (type == MSG_DATA && len >= sizeof(DataMessage)) {
-        // Also check if we need to wake up device on DATA message (in case CONFIG was lost)
-        String devName = "";
-        if (deviceNames.count(macStr)) {
-            devName = deviceNames[macStr];
-        }
+    if (!peers.ensure(mac, wifi_get_channel()) || esp_now_send(mac, frame, len) != 0) {
+        // No send callback follows: retried on the next uplink
+        if (count > 0) mailbox.settle(registry.indexOf(dev), false);
+        return;
+    }
+    if (count > 0) LOG_SERIAL.printf("Downlink: %u command(s) to %s\n", count, dev->name);
+}
 
-        if (devName.length() > 0 && stayAwakeState.count(devName) && stayAwakeState[devName]) {
-            CmdMessage cmd;
-            cmd.type = MSG_CMD;
-            cmd.cmdType = CMD_OTA;
-            cmd.value = true;
-            esp_now_add_peer(mac, ESP_NOW_ROLE_COMBO, 1, NULL, 0);
-            esp_now_send(mac, (uint8_t *)&cmd, sizeof(CmdMessage));
-            stayAwakeState[devName] = false; 
-            Serial.printf("Async OTA command sent to %s (via DATA)\n", devName.c_str());
-        }
+// Radio-level results of downlinks settle the commands they carried
+void processSendResults() {
+    static uint32_t txOverflows = 0;
+    uint8_t rec[7];
+    while (txRing.pop(rec, sizeof(rec)) == sizeof(rec)) {
+        DeviceEntry* dev = registry.find(rec);
+        if (dev) mailbox.settle(registry.indexOf(dev), rec[6] == 0);
+    }
+    if (txRing.overflows() != txOverflows) {
+        // Some results were lost and we cannot tell whose: resend everything in flight
+        txOverflows = txRing.overflows();
+        mailbox.requeueInFlight();
     }
-    enqueueMessage(mac, incomingData, len);
 }
 
-void processBuffer() {
-    while (head != tail) {
-        QueueItem& item = msgBuffer[tail];
-        char macStr[18];
-        snprintf(macStr, sizeof(macStr), "%02X:%02X:%02X:%02X:%02X:%02X", 
-                 item.mac[0], item.mac[1], item.mac[2], item.mac[3], item.mac[4], item.mac[5]);
+// Answers a Device's gateway discovery probe with our MAC and channel
+void sendProbeReply(uint8_t* mac) {
+    ProbeReplyMessage reply;
+    reply.type = MSG_PROBE_REPLY;
+    reply.channel = wifi_get_channel();
+    WiFi.macAddress(reply.gatewayMac);
+    if (!peers.ensure(mac, reply.channel)) return;
+    esp_now_send(mac, (uint8_t *)&reply, sizeof(ProbeReplyMessage));
+}
 
+struct QueueItem {
+    RxHeader hdr;
+    uint8_t data[250];
+    uint8_t len;
+};
+
+void processBuffer() {
+    QueueItem item;
+    uint16_t recLen;
+    while ((recLen = rxRing.pop((uint8_t*)&item, sizeof(item))) > 0) {
+        if (recLen <= sizeof(RxHeader)) continue;
+        item.len = recLen - sizeof(RxHeader);
+        uint8_t* mac = item.hdr.mac;
         uint8_t type = item.data[0];
-        StaticJsonDocument<512> doc;
-        doc["mac"] = macStr;
+        bool forward = false;
 
-        if (type == MSG_CONFIG && item.len >= sizeof(ConfigMessage)) {
+        uint32_t queuedUs = micros() - item.hdr.rxUs;
+        if (queuedUs > rxDelayMaxUs) rxDelayMaxUs = queuedUs;
+
+        if (type == MSG_PROBE && item.len >= sizeof(ProbeMessage)) {
+            sendProbeReply(mac);
+            continue; // Not forwarded
+        }
+
+        DeviceEntry* dev;
+        if (type == MSG_CONFIG && item.len >= CONFIG_MESSAGE_V1_SIZE) {
             ConfigMessage config;
-            memcpy(&config, item.data, sizeof(ConfigMessage));
-            bool alreadyKnown = deviceNames.count(macStr);
-            if (!alreadyKnown) {
-                deviceNames[macStr] = config.deviceName;
-                saveKnownDevices();
+            memcpy(&config, item.data, CONFIG_MESSAGE_V1_SIZE);
+            config.deviceName[sizeof(config.deviceName) - 1] = '\0';
+            dev = registry.upsert(mac, config.deviceName);
+            updateLinkReserve();
+            sendDownlink(mac, dev, false, 0);
+            // New, renamed or reconfigured devices are persisted from loop() when idle
+            uint32_t hash = fnv1a32(item.data, item.len < sizeof(ConfigMessage) ? item.len : sizeof(ConfigMessage));
+            if (dev && dev->configHash != hash) {
+                dev->configHash = hash;
+                dev->flags &= ~DEVICE_FLAG_SAVED;
             }
+            // Sent on boot, where the device's sequence numbers may restart
+            if (dev) dev->flags &= ~DEVICE_FLAG_SEQ_SEEN;
             // Always forward config so Transmitter can send discovery
-            doc["type"] = "CONFIG";
-            doc["deviceName"] = config.deviceName;
-            doc["sensorFlags"] = config.sensorFlags;
-            doc["sleepInterval"] = config.sleepInterval;
-        } 
-        else if (type == MSG_DATA && item.len >= sizeof(DataMessage)) {
-            DataMessage data;
-            memcpy(&data, item.data, sizeof(DataMessage));
-            doc["type"] = "DATA";
-            doc["deviceName"] = deviceNames.count(macStr) ? deviceNames[macStr] : "unknown";
-            doc["sensorFlags"] = data.sensorFlags;
-            doc["batteryVoltage"] = data.batteryVoltage;
-
-            if (data.sensorFlags & SENSOR_FLAG_BME) {
-                doc["temperature"] = data.bme.temperature;
-                doc["humidity"] = data.bme.humidity;
-                doc["pressure"] = data.bme.pressure;
-            }
-            if (data.sensorFlags & SENSOR_FLAG_LUX) {
-                doc["lux"] = data.lux.lux;
-            }
-            if (data.sensorFlags & SENSOR_FLAG_SOIL) {
-                doc["soil"] = data.soil.moisture;
-            }
-            if (data.sensorFlags & SENSOR_FLAG_BINARY) {
-                doc["binaryState"] = data.binary.state;
-            }
+            forward = true;
+        } else {
+            dev = registry.find(mac);
         }
 
-        if (doc.containsKey("type")) {
-            String json;
-            serializeJson(doc, json);
-            log("Gateway -> Transmitter: " + json);
-            swSerial.println(json);
-            delay(150); // Give transmitter time to process and avoid serial churn
+        // Replies first: the device is waiting for its ACK, the Transmitter is not
+        if (type == MSG_DATA && item.len >= sizeof(DataMessage)) {
+            sendDownlink(mac, dev, true, 0);
+            forward = true;
+        }
+        else if (type == MSG_DATA_V2 && item.len >= sizeof(DataHeaderV2)) {
+            DataHeaderV2 hdr;
+            memcpy(&hdr, item.data, sizeof(DataHeaderV2));
+            sendDownlink(mac, dev, true, hdr.seq);
+            // Forwarded as-is, the Transmitter decodes the TLV records; a retry is only ACKed
+            forward = !dev || deviceNoteSeq(*dev, hdr.seq);
+        }
+        else if (type == MSG_PROFILE && item.len >= offsetof(ProfileMessage, phases)) {
+            forward = true;
+        }
+        else if (type == MSG_BATCH && item.len >= sizeof(BatchHeader)) {
+            BatchHeader hdr;
+            memcpy(&hdr, item.data, sizeof(BatchHeader));
+            sendDownlink(mac, dev, true, hdr.lastSeq);
+            forward = !dev || deviceNoteSeq(*dev, hdr.lastSeq);
+        }
+
+        if (forward) {
+            // Raw packet goes over the link verbatim, tagged with the device id; the Transmitter expands it to JSON
+            if (dev && !(dev->flags & DEVICE_FLAG_ANNOUNCED)) announceDevice(*dev);
+            uint8_t payload[LINK_MAX_PAYLOAD];
+            size_t n = linkBuildRecord(deviceId(dev), mac, item.data, item.len, payload);
+            if (n > 0) {
+                linkQueue.push(LINK_FRAME_RECORD, payload, n);
+                logPrintf("Gateway -> Transmitter: %s from %s (%u bytes)",
+                          type == MSG_CONFIG ? "CONFIG" : type == MSG_PROFILE ? "PROFILE" : type == MSG_BATCH ? "BATCH" : "DATA",
+                          dev ? dev->name : "unknown", (unsigned)n);
+            }
         }
-        tail = (tail + 1) % BUFFER_SIZE;
     }
 }
 
@@ -204,30 +495,61 @@ uint8_t getCmdType(const char* cmdName) {
     if (cmd == "CMD_FLUSH") return CMD_FLUSH;
     if (cmd == "CMD_CONFIG" || cmd == "CMD_SEND_CONFIG") return CMD_CONFIG;
     if (cmd == "CMD_CALIBRATE") return CMD_OTA; // Reuse OTA mode for calibration
+    if (cmd == "CMD_SLEEP") return CMD_SLEEP;
     return 0;
 }
 
+const char* cmdName(uint8_t cmdType) {
+    switch (cmdType) {
+        case CMD_OTA: return "ota";
+        case CMD_RESTART: return "restart";
+        case CMD_UPDATE: return "update";
+        case CMD_FLUSH: return "flush";
+        case CMD_CONFIG: return "config";
+        case CMD_SLEEP: return "sleep";
+        default: return "unknown";
+    }
+}
+
+// Reports a device command's fate (queued/delivered/expired/rejected) to the Transmitter
+void sendCommandStatus(const char* deviceName, uint8_t cmdType, uint16_t id, const char* status) {
+    StaticJsonDocument<192> doc;
+    doc["type"] = "CMD_STATUS";
+    doc["deviceName"] = deviceName;
+    doc["cmd"] = cmdName(cmdType);
+    if (id != 0) doc["id"] = id;
+    doc["status"] = status;
+    String json; serializeJson(doc, json);
+    sendLinkJson(json);
+}
+
+void reportMail(const MailItem& item) {
+    const char* status = item.state == MAIL_DELIVERED ? "delivered" : "expired";
+    const char* name = item.device < registry.size() ? registry.at(item.device).name : "unknown";
+    log("Gateway: Command " + String(cmdName(item.cmdType)) + " #" + String(item.id) + " for " + String(name) + " " + status);
+    sendCommandStatus(name, item.cmdType, item.id, status);
+}
+
 void processCommand(String line) {
      if (line.length() > 0) {
             StaticJsonDocument<512> doc;
             DeserializationError error = deserializeJson(doc, line);
             if (!error) {
-                String targetDevice = doc.containsKey("device") ? doc["device"].as<String>() : "gateway";
-                String slugTarget = slugify(targetDevice);
-                String actualPrettyName = "";
-                for (auto const& [mac, name] : deviceNames) {
-                    if (slugify(name) == slugTarget) {
-                        actualPrettyName = name;
-                        break;
-                    }
+                if (doc["link"] == "credit") {
+                    handleLinkCredit(doc);
+                    return;
                 }
-                if (slugTarget == "gateway") actualPrettyName = "gateway";
+                const char* targetDevice = doc["device"] | "gateway";
+                char slugTarget[DEVICE_NAME_LEN];
+                slugifyInto(targetDevice, slugTarget, sizeof(slugTarget));
+                bool isGateway = strcmp(slugTarget, "gateway") == 0;
+                DeviceEntry* target = isGateway ? nullptr : registry.findBySlug(slugTarget);
 
                 if (doc.containsKey("cmd")) {
                     const char* cmdName = doc["cmd"];
                     uint8_t cmdType = getCmdType(cmdName);
                     if (cmdType != 0) {
-                        if (actualPrettyName == "gateway") {
+                        if (isGateway) {
                             if (cmdType == CMD_RESTART) {
                                 log("Gateway RESTART requested...");
                                 delay(100); ESP.restart();
@@ -237,26 +559,33 @@ void processCommand(String line) {
                                 otaStatusSent = false;
                             } else if (cmdType == CMD_FLUSH) {
                                 log("Gateway: Flushing known devices list...");
-                                deviceNames.clear();
-                                deviceMacs.clear();
-                                saveKnownDevices();
+                                forgetKnownDevices();
+                                updateLinkReserve();
+                                mailbox.clear(); // Keyed by registry index
                                 log("Gateway: Devices list flushed.");
                             }
-                        } else if (actualPrettyName != "" && deviceMacs.count(actualPrettyName)) {
-                            if (cmdType == CMD_OTA) {
-                                stayAwakeState[actualPrettyName] = true;
-                                log("Gateway: Queued OTA/Calibrate for " + actualPrettyName);
-                            } else {
-                                CmdMessage cmd;
-                                cmd.type = MSG_CMD;
-                                cmd.cmdType = cmdType;
-                                cmd.value = true;
-                                std::vector<uint8_t>& macVec = deviceMacs[actualPrettyName];
-                                uint8_t mac_addr[6];
-                                std::copy(macVec.begin(), macVec.end(), mac_addr);
-                                esp_now_add_peer(mac_addr, ESP_NOW_ROLE_COMBO, 1, NULL, 0);
-                                esp_now_send(mac_addr, (uint8_t*)&cmd, sizeof(CmdMessage));
+                        } else if (target) {
+                            // Devices are asleep: everything goes through the mailbox
+                            uint16_t arg0 = 0, arg1 = 0;
+                            if (cmdType == CMD_SLEEP) {
+                                arg0 = doc["min"] | 0;
+                                arg1 = doc["max"] | 0;
+                                if (arg0 == 0 || arg1 < arg0) {
+                                    log("Gateway: Invalid sleep bounds for " + String(target->name));
+                                    sendCommandStatus(target->name, cmdType, 0, "rejected");
+                                    return;
+                                }
                             }
+                            uint32_t ttl = doc["ttl"] | MAILBOX_DEFAULT_TTL_S;
+                            if (ttl == 0 || ttl > MAILBOX_MAX_TTL_S) ttl = MAILBOX_MAX_TTL_S;
+                            uint16_t id = mailbox.post(registry.indexOf(target), cmdType, true, arg0, arg1,
+                                                       millis(), ttl * 1000);
+                            log("Gateway: " + String(id ? "Queued " : "Mailbox full, dropped ") + cmdName(cmdType) +
+                                " for " + String(target->name));
+                            sendCommandStatus(target->name, cmdType, id, id ? "queued" : "rejected");
+                        } else {
+                            log("Gateway: Unknown device " + String(targetDevice));
+                            sendCommandStatus(targetDevice, cmdType, 0, "unknown_device");
                         }
                     }
                     return; 
@@ -266,17 +595,18 @@ void processCommand(String line) {
 }
 
 void setup() {
-    Serial.begin(115200);
-    swSerial.begin(9600);
+    linkBegin();
     if (!LittleFS.begin()) {
-        Serial.println("LittleFS mount failed");
+        LOG_SERIAL.println("LittleFS mount failed");
     }
     loadKnownDevices();
+    updateLinkReserve();
     WiFi.mode(WIFI_STA);
     wifi_set_channel(1);
     if (esp_now_init() != 0) return;
     esp_now_set_self_role(ESP_NOW_ROLE_SLAVE);
     esp_now_register_recv_cb(onDataRecv);
+    esp_now_register_send_cb(onDataSent);
 
     delay(100);
     StaticJsonDocument<128> bootDoc;
@@ -285,19 +615,42 @@ void setup() {
     // Add connection info? In normal mode it's just ESP-NOW link to Transmitter
     // but maybe version or something. "online" is enough.
     String bootJson; serializeJson(bootDoc, bootJson);
-    swSerial.println(bootJson);
+    sendLinkJson(bootJson);
+}
+
+// Collects a command line from the Transmitter without blocking, so the
+// receive stage (and the ACKs devices wait for) keeps running mid-line
+bool readCommandLine(Stream& input, String& line) {
+    static char buf[512];
+    static size_t len = 0;
+    while (input.available()) {
+        char c = input.read();
+        if (c == '\n') {
+            buf[len] = '\0';
+            line = buf;
+            len = 0;
+            return true;
+        }
+        if (len < sizeof(buf) - 1) buf[len++] = c;
+    }
+    return false;
 }
 
 void loop() {
     processBuffer();
+    processSendResults();
+    serviceLink();
+    if (rxRing.empty()) persistDevices();
+    mailbox.expire(millis());
+    mailbox.drain(reportMail);
     if (otaMode) {
         ArduinoOTA.handle();
     }
 
-    if (swSerial.available() || Serial.available()) {
-        Stream& input = swSerial.available() ? static_cast<Stream&>(swSerial) : static_cast<Stream&>(Serial);
-        String line = input.readStringUntil('\n');
-        processCommand(line);
+    if (linkSerial.available() || Serial.available()) {
+        Stream& input = linkSerial.available() ? static_cast<Stream&>(linkSerial) : static_cast<Stream&>(Serial);
+        String line;
+        if (readCommandLine(input, line)) processCommand(line);
     }
 
     if (otaMode) {
@@ -338,7 +691,7 @@ void loop() {
                   sDoc["status"] = "ota";
                   sDoc["connection"] = WiFi.localIP().toString();
                   String json; serializeJson(sDoc, json);
-                  log(json); swSerial.println(json);
+                  log(json); sendLinkJson(json);
                   otaStatusSent = true;
             }
         }
@@ -349,11 +702,23 @@ void loop() {
     static unsigned long lastHeartbeat = 0;
     if (millis() - lastHeartbeat > 30000) {
         lastHeartbeat = millis();
-        StaticJsonDocument<64> doc;
+        StaticJsonDocument<384> doc;
         doc["type"] = "HEARTBEAT";
         doc["device"] = "gateway";
+        doc["rxDropped"] = rxRing.overflows();
+        doc["rxHighWater"] = rxRing.highWater();
+        doc["mailbox"] = mailbox.pending();
+        doc["peerHits"] = peers.stats().hits;
+        doc["peerMisses"] = peers.stats().misses;
+        doc["peerEvictions"] = peers.stats().evictions;
+        doc["linkQueued"] = linkQueue.used();
+        doc["linkDropped"] = linkQueue.dropped();
+        doc["linkRetransmits"] = linkRetransmits;
+        doc["rxCallbackMaxUs"] = rxCallbackMaxUs;
+        doc["rxDelayMaxUs"] = rxDelayMaxUs;
+        rxDelayMaxUs = 0;
         String json; serializeJson(doc, json);
-        swSerial.println(json);
+        sendLinkJson(json);
         // log("Sent Heartbeat"); // Quiet to avoid spam
     }
 }
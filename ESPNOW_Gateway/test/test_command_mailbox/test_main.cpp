@@ -0,0 +1,92 @@
+#include <unity.h>
+#include "command_mailbox.h"
+
+// CommandMailbox: coalescing, ordering, send results, lost results and expiry
+
+#define CMD_A 1
+#define CMD_LAST 2 // Sent after the others, like CMD_RESTART
+#define CMD_B 3
+#define CMD_C 6
+
+static CommandMailbox<8, 4> mailbox;
+static uint8_t delivered;
+static uint8_t expired;
+
+static void report(const MailItem& m) {
+    if (m.state == MAIL_DELIVERED) delivered++;
+    if (m.state == MAIL_EXPIRED) expired++;
+}
+
+void setUp() {
+    mailbox.clear();
+    delivered = 0;
+    expired = 0;
+}
+void tearDown() {}
+
+void test_post_take_and_settle() {
+    TEST_ASSERT_NOT_EQUAL(0, mailbox.post(1, CMD_LAST, true, 0, 0, 0, 1000));
+    uint16_t a = mailbox.post(1, CMD_A, true, 0, 0, 0, 1000);
+    uint16_t c = mailbox.post(1, CMD_C, true, 10, 20, 0, 1000);
+    TEST_ASSERT_EQUAL(c, mailbox.post(1, CMD_C, true, 30, 40, 0, 1000)); // Updated in place
+    TEST_ASSERT_NOT_EQUAL(0, mailbox.post(1, CMD_B, true, 0, 0, 0, 1000));
+    TEST_ASSERT_EQUAL(0, mailbox.post(1, 5, true, 0, 0, 0, 1000)); // 4 per device
+
+    MailItem out[4];
+    TEST_ASSERT_EQUAL(4, mailbox.take(1, out, 4, 0, CMD_LAST));
+    TEST_ASSERT_EQUAL(a, out[0].id);
+    TEST_ASSERT_EQUAL(30, out[1].arg0);
+    TEST_ASSERT_EQUAL(CMD_LAST, out[3].cmdType);
+
+    mailbox.settle(1, false); // Send failed: queued again
+    TEST_ASSERT_EQUAL(4, mailbox.take(1, out, 4, 0, CMD_LAST));
+    mailbox.settle(1, true);
+    mailbox.drain(report);
+    TEST_ASSERT_EQUAL(4, delivered);
+    TEST_ASSERT_EQUAL(0, mailbox.pending());
+}
+
+void test_lost_result_times_out() {
+    MailItem out[4];
+    mailbox.post(1, CMD_A, true, 0, 0, 0, 60000);
+    TEST_ASSERT_EQUAL(1, mailbox.take(1, out, 4, 1000));
+    mailbox.expire(1000 + MAIL_INFLIGHT_TIMEOUT_MS - 1);
+    TEST_ASSERT_EQUAL(0, mailbox.take(1, out, 4, 0)); // Still in flight
+    mailbox.expire(1000 + MAIL_INFLIGHT_TIMEOUT_MS);
+    TEST_ASSERT_EQUAL(1, mailbox.take(1, out, 4, 5000)); // Queued again, so sent again
+    mailbox.drain(report);
+    TEST_ASSERT_EQUAL(0, delivered + expired);
+}
+
+void test_requeue_in_flight() {
+    MailItem out[4];
+    mailbox.post(1, CMD_A, true, 0, 0, 0, 60000);
+    mailbox.post(2, CMD_B, true, 0, 0, 0, 60000);
+    mailbox.post(3, CMD_C, true, 0, 0, 0, 60000);
+    mailbox.take(1, out, 4, 0);
+    mailbox.take(2, out, 4, 0);
+    mailbox.requeueInFlight();
+    TEST_ASSERT_EQUAL(1, mailbox.take(1, out, 4, 0));
+    TEST_ASSERT_EQUAL(1, mailbox.take(2, out, 4, 0));
+    TEST_ASSERT_EQUAL(3, mailbox.pending());
+}
+
+void test_ttl_expiry() {
+    mailbox.post(2, CMD_A, true, 0, 0, 100, 50);
+    mailbox.expire(149);
+    mailbox.drain(report);
+    TEST_ASSERT_EQUAL(0, expired);
+    mailbox.expire(150);
+    mailbox.drain(report);
+    TEST_ASSERT_EQUAL(1, expired);
+    TEST_ASSERT_EQUAL(0, mailbox.pending());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_post_take_and_settle);
+    RUN_TEST(test_lost_result_times_out);
+    RUN_TEST(test_requeue_in_flight);
+    RUN_TEST(test_ttl_expiry);
+    return UNITY_END();
+}
@@ -0,0 +1,188 @@
+#include <unity.h>
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <string>
+#include "device_registry.h"
+
+// DeviceRegistry tests and a lookup benchmark against the std::map tables it
+// replaced. The Gateway uses DeviceRegistry<64> (MAX_DEVICES); the benchmark
+// instantiates DeviceRegistry<512> so it can be measured with 500 devices.
+
+void setUp() {}
+void tearDown() {}
+
+static void makeMac(uint32_t i, uint8_t* mac) {
+    const uint8_t oui[3] = {0x24, 0x6F, 0x28}; // One vendor, as in a real fleet
+    memcpy(mac, oui, 3);
+    mac[3] = (uint8_t)(i >> 16);
+    mac[4] = (uint8_t)(i >> 8);
+    mac[5] = (uint8_t)i;
+}
+
+void test_upsert_and_find() {
+    static DeviceRegistry<8> reg;
+    reg.clear();
+    uint8_t mac[6];
+    bool created;
+    makeMac(1, mac);
+    DeviceEntry* e = reg.upsert(mac, "Living Room", &created);
+    TEST_ASSERT_NOT_NULL(e);
+    TEST_ASSERT_TRUE(created);
+    TEST_ASSERT_EQUAL_STRING("living_room", e->slug);
+    TEST_ASSERT_EQUAL_PTR(e, reg.find(mac));
+    TEST_ASSERT_EQUAL_PTR(e, reg.findBySlug("living_room"));
+
+    e->flags = DEVICE_FLAG_SAVED | DEVICE_FLAG_ANNOUNCED;
+    TEST_ASSERT_EQUAL_PTR(e, reg.upsert(mac, "Living Room", &created));
+    TEST_ASSERT_FALSE(created);
+    TEST_ASSERT_EQUAL(DEVICE_FLAG_SAVED | DEVICE_FLAG_ANNOUNCED, e->flags); // Same name keeps its flags
+
+    reg.upsert(mac, "Kitchen");
+    TEST_ASSERT_EQUAL(0, e->flags); // A rename must be saved and announced again
+    TEST_ASSERT_NULL(reg.findBySlug("living_room"));
+    TEST_ASSERT_EQUAL_PTR(e, reg.findBySlug("kitchen"));
+    TEST_ASSERT_EQUAL(1, reg.size());
+
+    makeMac(2, mac);
+    TEST_ASSERT_NULL(reg.find(mac));
+}
+
+void test_full_registry() {
+    static DeviceRegistry<8> reg;
+    reg.clear();
+    uint8_t mac[6];
+    char name[16];
+    for (uint32_t i = 0; i < 8; i++) {
+        makeMac(i, mac);
+        snprintf(name, sizeof(name), "Sensor %u", i);
+        TEST_ASSERT_NOT_NULL(reg.upsert(mac, name));
+    }
+    makeMac(8, mac);
+    TEST_ASSERT_NULL(reg.upsert(mac, "One Too Many"));
+    for (uint32_t i = 0; i < 8; i++) {
+        makeMac(i, mac);
+        TEST_ASSERT_EQUAL(i, reg.indexOf(reg.find(mac)));
+    }
+}
+
+void test_duplicate_seq() {
+    DeviceRegistry<8> reg;
+    uint8_t mac[6];
+    makeMac(1, mac);
+    DeviceEntry* e = reg.upsert(mac, "Porch");
+    TEST_ASSERT_TRUE(deviceNoteSeq(*e, 0)); // First uplink, even with seq 0
+    TEST_ASSERT_FALSE(deviceNoteSeq(*e, 0)); // Retry after a late ACK
+    TEST_ASSERT_TRUE(deviceNoteSeq(*e, 1));
+    TEST_ASSERT_FALSE(deviceNoteSeq(*e, 1));
+    e->flags &= ~DEVICE_FLAG_SEQ_SEEN; // CONFIG after a reboot
+    TEST_ASSERT_TRUE(deviceNoteSeq(*e, 1));
+}
+
+void test_mac_helpers() {
+    uint8_t mac[6] = {0x24, 0x6F, 0x28, 0x0A, 0xBC, 0xDE};
+    uint8_t back[6];
+    char str[18];
+    keyToMac(macToKey(mac), back);
+    TEST_ASSERT_EQUAL_MEMORY(mac, back, 6);
+    formatMac(mac, str);
+    TEST_ASSERT_EQUAL_STRING("24:6F:28:0A:BC:DE", str);
+    TEST_ASSERT_TRUE(parseMac(str, back));
+    TEST_ASSERT_EQUAL_MEMORY(mac, back, 6);
+    TEST_ASSERT_FALSE(parseMac("24:6F:28", back));
+}
+
+// The tables the registry replaced: MAC string -> name, looked up per packet
+// after formatting the MAC, and a slugify of every name per command
+static std::string slugOf(const std::string& name) {
+    char slug[DEVICE_NAME_LEN];
+    slugifyInto(name.c_str(), slug, sizeof(slug));
+    return slug;
+}
+
+static double nsPer(std::chrono::steady_clock::time_point start, uint32_t ops) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ops;
+}
+
+static volatile uint32_t sink; // Keeps the lookups from being optimised away
+
+static void benchmark(uint16_t devices) {
+    static DeviceRegistry<512> reg;
+    std::map<std::string, std::string> deviceNames;
+    reg.clear();
+    uint8_t mac[6];
+    char macStr[18];
+    char name[DEVICE_NAME_LEN];
+    for (uint16_t i = 0; i < devices; i++) {
+        makeMac(i * 7919, mac);
+        snprintf(name, sizeof(name), "Sensor %u", i);
+        TEST_ASSERT_NOT_NULL(reg.upsert(mac, name));
+        formatMac(mac, macStr);
+        deviceNames[macStr] = name;
+    }
+
+    const uint32_t lookups = 200000;
+    uint32_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < lookups; n++) {
+        makeMac((n % devices) * 7919, mac);
+        formatMac(mac, macStr);
+        auto it = deviceNames.find(macStr);
+        if (it != deviceNames.end()) found += it->second.size();
+    }
+    double mapMac = nsPer(start, lookups);
+
+    uint32_t foundReg = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < lookups; n++) {
+        makeMac((n % devices) * 7919, mac);
+        DeviceEntry* e = reg.find(mac);
+        if (e) foundReg += strlen(e->name);
+    }
+    double regMac = nsPer(start, lookups);
+    TEST_ASSERT_EQUAL(found, foundReg);
+
+    const uint32_t commands = 20000;
+    char slug[DEVICE_NAME_LEN];
+    found = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < commands; n++) {
+        snprintf(slug, sizeof(slug), "sensor_%u", n % devices);
+        for (auto& kv : deviceNames) {
+            if (slugOf(kv.second) == slug) { found++; break; }
+        }
+    }
+    double mapSlug = nsPer(start, commands);
+
+    foundReg = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < commands; n++) {
+        snprintf(slug, sizeof(slug), "sensor_%u", n % devices);
+        if (reg.findBySlug(slug)) foundReg++;
+    }
+    double regSlug = nsPer(start, commands);
+    TEST_ASSERT_EQUAL(commands, found);
+    TEST_ASSERT_EQUAL(found, foundReg);
+    sink = found + foundReg;
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%3u devices: by MAC %6.1f ns (map) vs %5.1f ns (registry), by slug %8.1f ns vs %5.1f ns",
+             devices, mapMac, regMac, mapSlug, regSlug);
+    TEST_MESSAGE(msg);
+}
+
+void test_benchmark_lookup() {
+    benchmark(10);
+    benchmark(100);
+    benchmark(500);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_upsert_and_find);
+    RUN_TEST(test_full_registry);
+    RUN_TEST(test_duplicate_seq);
+    RUN_TEST(test_mac_helpers);
+    RUN_TEST(test_benchmark_lookup);
+    return UNITY_END();
+}
@@ -0,0 +1,149 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include "device_store.h"
+
+// Device log tests with 1,000 devices: replay, power-loss truncation, a
+// corrupt record, compaction, and the time a boot spends loading the deviceLog.
+// DeviceRegistry<1024> stands in for the Gateway's 64 entry registry.
+
+#define FLEET_SIZE 1000
+
+// In-memory log with the read() the replay expects from a LittleFS File
+struct MemoryLog {
+    uint8_t data[(FLEET_SIZE + 64) * sizeof(DeviceRecord)];
+    size_t len = 0;
+    size_t pos = 0;
+
+    size_t read(uint8_t* out, size_t n) {
+        if (n > len - pos) n = len - pos;
+        memcpy(out, data + pos, n);
+        pos += n;
+        return n;
+    }
+
+    void append(const DeviceEntry& e) {
+        DeviceRecord r;
+        deviceRecordFrom(e, r);
+        memcpy(data + len, &r, sizeof(r));
+        len += sizeof(r);
+    }
+};
+
+static MemoryLog deviceLog;
+static DeviceRegistry<1024> written;
+static DeviceRegistry<1024> loaded;
+
+static void deviceMac(uint16_t i, uint8_t* mac) {
+    const uint8_t base[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x00};
+    memcpy(mac, base, 6);
+    mac[4] = (uint8_t)(i >> 8);
+    mac[5] = (uint8_t)i;
+}
+
+static size_t replay(uint32_t& records) {
+    loaded.clear();
+    deviceLog.pos = 0;
+    return deviceLogReplay(deviceLog, loaded, records);
+}
+
+// 1,000 registrations, then 10 renames appended as the Gateway does
+void setUp() {
+    deviceLog.len = 0;
+    written.clear();
+    uint8_t mac[6];
+    char name[DEVICE_NAME_LEN];
+    for (uint16_t i = 0; i < FLEET_SIZE; i++) {
+        deviceMac(i, mac);
+        snprintf(name, sizeof(name), "Sensor %u", i);
+        DeviceEntry* e = written.upsert(mac, name);
+        e->configHash = i * 7u + 1;
+        deviceLog.append(*e);
+    }
+    for (uint16_t i = 0; i < 10; i++) {
+        deviceMac(i, mac);
+        snprintf(name, sizeof(name), "Renamed %u", i);
+        deviceLog.append(*written.upsert(mac, name));
+    }
+}
+void tearDown() {}
+
+void test_replay_rebuilds_registry() {
+    uint32_t records;
+    TEST_ASSERT_EQUAL(deviceLog.len, replay(records));
+    TEST_ASSERT_EQUAL(FLEET_SIZE + 10, records);
+    TEST_ASSERT_EQUAL(FLEET_SIZE, loaded.size());
+
+    uint8_t mac[6];
+    deviceMac(0, mac);
+    TEST_ASSERT_EQUAL_STRING("Renamed 0", loaded.find(mac)->name); // Later record wins
+    TEST_ASSERT_NOT_NULL(loaded.findBySlug("renamed_0"));
+    deviceMac(999, mac);
+    DeviceEntry* e = loaded.find(mac);
+    TEST_ASSERT_EQUAL_STRING("Sensor 999", e->name);
+    TEST_ASSERT_EQUAL(999 * 7u + 1, e->configHash);
+    TEST_ASSERT_EQUAL(DEVICE_FLAG_SAVED, e->flags); // Runtime flags are not persisted
+}
+
+void test_power_loss_truncation() {
+    uint32_t records;
+    size_t full = deviceLog.len;
+    deviceLog.len -= 17; // Last append cut short
+    TEST_ASSERT_EQUAL(full - sizeof(DeviceRecord), replay(records));
+    TEST_ASSERT_EQUAL(FLEET_SIZE + 9, records);
+    uint8_t mac[6];
+    deviceMac(9, mac);
+    TEST_ASSERT_EQUAL_STRING("Sensor 9", loaded.find(mac)->name); // Rename lost, device kept
+
+    // Erased flash after the cut (0xFF) is not a record either
+    memset(deviceLog.data + deviceLog.len, 0xFF, sizeof(DeviceRecord));
+    deviceLog.len += sizeof(DeviceRecord);
+    TEST_ASSERT_EQUAL(full - sizeof(DeviceRecord), replay(records));
+}
+
+void test_corrupt_record_stops_replay() {
+    uint32_t records;
+    deviceLog.data[50 * sizeof(DeviceRecord) + 10] ^= 0x01;
+    TEST_ASSERT_EQUAL(50 * sizeof(DeviceRecord), replay(records));
+    TEST_ASSERT_EQUAL(50, records);
+    TEST_ASSERT_EQUAL(50, loaded.size());
+}
+
+void test_compaction_keeps_devices() {
+    uint32_t records;
+    replay(records);
+
+    // Rewrite one record per device, as the Gateway's compaction does
+    deviceLog.len = 0;
+    for (uint16_t i = 0; i < loaded.size(); i++) deviceLog.append(loaded.at(i));
+    TEST_ASSERT_EQUAL(FLEET_SIZE * sizeof(DeviceRecord), replay(records));
+    TEST_ASSERT_EQUAL(FLEET_SIZE, records);
+    for (uint16_t i = 0; i < FLEET_SIZE; i++) {
+        TEST_ASSERT_EQUAL_STRING(written.at(i).name, loaded.at(i).name);
+        TEST_ASSERT_EQUAL(written.at(i).configHash, loaded.at(i).configHash);
+    }
+}
+
+void test_boot_load_time() {
+    uint32_t records;
+    const int rounds = 100;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) replay(records);
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%u records of %u bytes (%u KB) replayed in %.0f us on the host",
+             records, (unsigned)sizeof(DeviceRecord), (unsigned)(deviceLog.len / 1024), us);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL(FLEET_SIZE, loaded.size());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_replay_rebuilds_registry);
+    RUN_TEST(test_power_loss_truncation);
+    RUN_TEST(test_corrupt_record_stops_replay);
+    RUN_TEST(test_compaction_keeps_devices);
+    RUN_TEST(test_boot_load_time);
+    return UNITY_END();
+}
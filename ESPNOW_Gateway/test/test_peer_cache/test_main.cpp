@@ -0,0 +1,140 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "peer_cache.h"
+
+// PeerCache against a simulated 20-slot radio peer table, with the Gateway's
+// 16 cache slots and a fleet of 200 devices.
+
+#define RADIO_SLOTS 20
+#define FLEET_SIZE  200
+
+// Behaves like esp_now_add_peer()/esp_now_del_peer(): adding fails when the
+// table is full or the peer exists, unicast only reaches registered peers
+static uint8_t radioTable[RADIO_SLOTS][6];
+static uint8_t radioCount;
+static uint32_t radioAdds;
+static bool radioRefuses;
+
+static int radioFind(const uint8_t* mac) {
+    for (uint8_t i = 0; i < radioCount; i++) if (memcmp(radioTable[i], mac, 6) == 0) return i;
+    return -1;
+}
+
+static bool radioAdd(const uint8_t* mac, uint8_t) {
+    if (radioRefuses || radioCount == RADIO_SLOTS || radioFind(mac) >= 0) return false;
+    memcpy(radioTable[radioCount++], mac, 6);
+    radioAdds++;
+    return true;
+}
+
+static void radioDel(const uint8_t* mac) {
+    int i = radioFind(mac);
+    TEST_ASSERT_TRUE(i >= 0); // The cache must only remove peers it added
+    memcpy(radioTable[i], radioTable[--radioCount], 6);
+}
+
+static bool radioSend(const uint8_t* mac) { return radioFind(mac) >= 0; }
+
+static void deviceMac(uint16_t i, uint8_t* mac) {
+    const uint8_t base[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x00};
+    memcpy(mac, base, 6);
+    mac[4] = (uint8_t)(i >> 8);
+    mac[5] = (uint8_t)i;
+}
+
+static PeerCache<16> cache(radioAdd, radioDel);
+
+void setUp() {
+    radioCount = 0;
+    radioAdds = 0;
+    radioRefuses = false;
+    cache.clear();
+}
+void tearDown() {}
+
+void test_hit_and_lru_eviction() {
+    uint8_t mac[6];
+    for (uint16_t i = 0; i < 16; i++) {
+        deviceMac(i, mac);
+        TEST_ASSERT_TRUE(cache.ensure(mac, 1));
+    }
+    deviceMac(0, mac);
+    TEST_ASSERT_TRUE(cache.ensure(mac, 1)); // Device 0 is now the most recent
+    TEST_ASSERT_EQUAL(1, cache.stats().hits);
+
+    deviceMac(16, mac);
+    TEST_ASSERT_TRUE(cache.ensure(mac, 1));
+    TEST_ASSERT_EQUAL(1, cache.stats().evictions);
+    deviceMac(1, mac);
+    TEST_ASSERT_FALSE(radioSend(mac)); // Least recently used went
+    deviceMac(0, mac);
+    TEST_ASSERT_TRUE(radioSend(mac));
+    TEST_ASSERT_EQUAL(16, cache.size());
+    TEST_ASSERT_EQUAL(16, radioCount);
+}
+
+void test_channel_change_readds() {
+    uint8_t mac[6];
+    deviceMac(7, mac);
+    TEST_ASSERT_TRUE(cache.ensure(mac, 1));
+    TEST_ASSERT_TRUE(cache.ensure(mac, 6));
+    TEST_ASSERT_EQUAL(2, cache.stats().misses);
+    TEST_ASSERT_EQUAL(0, cache.stats().evictions);
+    TEST_ASSERT_EQUAL(1, radioCount);
+}
+
+void test_add_failure_is_retried() {
+    uint8_t mac[6];
+    deviceMac(3, mac);
+    radioRefuses = true;
+    TEST_ASSERT_FALSE(cache.ensure(mac, 1));
+    TEST_ASSERT_EQUAL(1, cache.stats().addFailures);
+    TEST_ASSERT_EQUAL(0, cache.size());
+
+    radioRefuses = false;
+    TEST_ASSERT_TRUE(cache.ensure(mac, 1));
+    TEST_ASSERT_TRUE(radioSend(mac));
+}
+
+// 200 devices wake in random order and each gets a downlink. A peer the
+// cache does not own sits in the SDK table too (the Gateway leaves 4 of the 20
+// slots spare for such), and must survive.
+void test_fleet_of_200() {
+    const uint8_t foreign[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    TEST_ASSERT_TRUE(radioAdd(foreign, 1));
+
+    srand(1);
+    uint8_t mac[6];
+    const uint32_t downlinks = 100000;
+    uint32_t delivered = 0;
+    for (uint32_t n = 0; n < downlinks; n++) {
+        // Some devices are busier than others: half the traffic comes from 10 of them
+        uint16_t device = (rand() & 1) ? rand() % 10 : rand() % FLEET_SIZE;
+        deviceMac(device, mac);
+        if (cache.ensure(mac, 1) && radioSend(mac)) delivered++;
+        TEST_ASSERT_LESS_OR_EQUAL(RADIO_SLOTS, radioCount);
+    }
+
+    const PeerCacheStats& s = cache.stats();
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%u downlinks: %u hits, %u misses, %u evictions, %u add failures",
+             downlinks, s.hits, s.misses, s.evictions, s.addFailures);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL(downlinks, delivered);
+    TEST_ASSERT_EQUAL(downlinks, s.hits + s.misses);
+    TEST_ASSERT_EQUAL(0, s.addFailures);
+    TEST_ASSERT_EQUAL(s.misses - 16, s.evictions);
+    TEST_ASSERT_EQUAL(16, cache.size());
+    TEST_ASSERT_EQUAL(17, radioCount);
+    TEST_ASSERT_TRUE(radioSend(foreign)); // Never evicted
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_hit_and_lru_eviction);
+    RUN_TEST(test_channel_change_readds);
+    RUN_TEST(test_add_failure_is_retried);
+    RUN_TEST(test_fleet_of_200);
+    return UNITY_END();
+}
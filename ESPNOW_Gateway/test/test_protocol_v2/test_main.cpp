@@ -0,0 +1,215 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include "protocol_v2.h"
+#include "serial_link.h"
+
+// Protocol v2 round-trip accuracy tests and an encode/decode benchmark of the
+// path a reading takes: TLV on the Device, COBS/CRC link frame on the Gateway,
+// back to a DataMessage on the Transmitter.
+
+void setUp() {}
+void tearDown() {}
+
+static const uint8_t ALL_SENSORS = SENSOR_FLAG_BME | SENSOR_FLAG_LUX | SENSOR_FLAG_SOIL | SENSOR_FLAG_BINARY;
+
+static SensorSample sampleOf(uint8_t flags, float battery, float temperature, float humidity,
+                             float pressure, float lux, float soil, bool binary) {
+    BMEData bme = {temperature, humidity, pressure};
+    LuxData l = {lux};
+    SoilData s = {soil};
+    BinaryData b = {binary};
+    SensorSample out;
+    sampleFromReadings(flags, battery, bme, l, s, b, out);
+    return out;
+}
+
+// Encodes, decodes and converts back to floats; each value must be within half
+// a step of its fixed-point resolution
+static void roundTrip(float battery, float temperature, float humidity, float pressure, float lux, float soil) {
+    SensorSample in = sampleOf(ALL_SENSORS, battery, temperature, humidity, pressure, lux, soil, true);
+    uint8_t frame[DATA_V2_MAX_SIZE];
+    size_t len = encodeDataV2(in, 4242, frame);
+    TEST_ASSERT_LESS_OR_EQUAL(DATA_V2_MAX_SIZE, len);
+
+    SensorSample out;
+    uint16_t seq;
+    TEST_ASSERT_TRUE(decodeDataV2(frame, len, out, seq));
+    TEST_ASSERT_EQUAL(4242, seq);
+    TEST_ASSERT_EQUAL_MEMORY(&in, &out, sizeof(in));
+
+    DataMessage msg;
+    sampleToDataMessage(out, msg);
+    TEST_ASSERT_EQUAL(MSG_DATA, msg.type);
+    TEST_ASSERT_EQUAL(ALL_SENSORS, msg.sensorFlags);
+    TEST_ASSERT_FLOAT_WITHIN(0.0005f, battery, msg.batteryVoltage);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, temperature, msg.bme.temperature);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, humidity, msg.bme.humidity);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, pressure, msg.bme.pressure);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f + lux * 1e-6f, lux, msg.lux.lux); // float has ~7 digits
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, soil, msg.soil.moisture);
+    TEST_ASSERT_TRUE(msg.binary.state);
+}
+
+void test_round_trip_accuracy() {
+    roundTrip(3.712f, 21.37f, 45.6f, 1013.2f, 123.4f, 57.0f);
+    roundTrip(2.8f, -12.34f, 0.0f, 870.1f, 0.0f, 0.0f);
+    roundTrip(4.2f, 59.99f, 99.9f, 1084.9f, 65535.9f, 100.0f);
+    roundTrip(3.3f, 0.0f, 12.3f, 1000.0f, 100000.0f, 3.0f); // Direct sunlight
+}
+
+void test_clamps_out_of_range() {
+    SensorSample s = sampleOf(ALL_SENSORS, -1.0f, 400.0f, 150.0f, NAN, -5.0f, 140.0f, false);
+    TEST_ASSERT_EQUAL(0, s.batteryMv);
+    TEST_ASSERT_EQUAL(32767, s.temperature);
+    TEST_ASSERT_EQUAL(1000, s.humidity);
+    TEST_ASSERT_EQUAL(0, s.pressure); // NaN (sensor read failed)
+    TEST_ASSERT_EQUAL(0, s.lux);
+    TEST_ASSERT_EQUAL(100, s.soil);
+}
+
+void test_frame_sizes() {
+    uint8_t frame[DATA_V2_MAX_SIZE];
+    SensorSample door = sampleOf(SENSOR_FLAG_BINARY, 3.0f, 0, 0, 0, 0, 0, true);
+    TEST_ASSERT_EQUAL(12, encodeDataV2(door, 1, frame));
+    const uint8_t climate = SENSOR_FLAG_BME | SENSOR_FLAG_LUX | SENSOR_FLAG_SOIL;
+    SensorSample dim = sampleOf(climate, 3.7f, 21.0f, 50.0f, 1013.0f, 250.0f, 40.0f, false);
+    TEST_ASSERT_EQUAL(24, encodeDataV2(dim, 1, frame));
+    SensorSample bright = sampleOf(climate, 3.7f, 21.0f, 50.0f, 1013.0f, 25000.0f, 40.0f, false);
+    TEST_ASSERT_EQUAL(25, encodeDataV2(bright, 1, frame)); // Lux needs a third byte
+    TEST_ASSERT_LESS_THAN(sizeof(DataMessage), 25);
+}
+
+void test_decode_rejects_bad_frames() {
+    SensorSample s = sampleOf(ALL_SENSORS, 3.7f, 21.0f, 50.0f, 1013.0f, 250.0f, 40.0f, false);
+    uint8_t frame[DATA_V2_MAX_SIZE + 4];
+    size_t len = encodeDataV2(s, 7, frame);
+    SensorSample out;
+    uint16_t seq;
+
+    TEST_ASSERT_FALSE(decodeDataV2(frame, len - 1, out, seq)); // Truncated record
+    TEST_ASSERT_FALSE(decodeDataV2(frame, 3, out, seq));       // Short header
+    frame[1] = 3;
+    TEST_ASSERT_FALSE(decodeDataV2(frame, len, out, seq));     // Other version
+    frame[1] = PROTOCOL_VERSION_2;
+
+    // An unknown tag from a newer Device is skipped
+    frame[len++] = 0x7F;
+    frame[len++] = 2;
+    frame[len++] = 0xAA;
+    frame[len++] = 0xBB;
+    TEST_ASSERT_TRUE(decodeDataV2(frame, len, out, seq));
+    TEST_ASSERT_EQUAL_MEMORY(&s, &out, sizeof(s));
+}
+
+void test_batch_round_trip() {
+    const uint8_t flags = SENSOR_FLAG_BME | SENSOR_FLAG_SOIL;
+    uint8_t frame[BATCH_MAX_FRAME];
+    BatchHeader hdr = {MSG_BATCH, PROTOCOL_VERSION_2, flags, 0, 0};
+    size_t len = sizeof(hdr);
+
+    TimedSample samples[20];
+    TimedSample prev;
+    memset(&prev, 0, sizeof(prev));
+    for (uint8_t i = 0; i < 20; i++) {
+        TimedSample& ts = samples[i];
+        ts.t = 3600 - i * 120;           // Age: oldest first
+        ts.seq = (uint16_t)(65530 + i);  // Wraps
+        ts.s = sampleOf(flags, 3.7f - i * 0.001f, 20.0f - i * 0.1f, 55.0f + i, 1013.0f, 0, 40.0f + i % 3, false);
+        len += encodeSampleDelta(ts, prev, flags, frame + len);
+        prev = ts;
+        hdr.count++;
+        hdr.lastSeq = ts.seq;
+    }
+    memcpy(frame, &hdr, sizeof(hdr));
+    TEST_ASSERT_LESS_OR_EQUAL(BATCH_MAX_FRAME, len);
+
+    BatchReader reader(frame, len);
+    TEST_ASSERT_TRUE(reader.valid());
+    TimedSample ts;
+    uint8_t n = 0;
+    while (reader.next(ts)) {
+        TEST_ASSERT_EQUAL(samples[n].t, ts.t);
+        TEST_ASSERT_EQUAL(samples[n].seq, ts.seq);
+        TEST_ASSERT_EQUAL_MEMORY(&samples[n].s, &ts.s, sizeof(ts.s));
+        n++;
+    }
+    TEST_ASSERT_EQUAL(20, n);
+    TEST_ASSERT_TRUE(reader.valid());
+
+    BatchReader truncated(frame, len - 1);
+    while (truncated.next(ts)) {}
+    TEST_ASSERT_FALSE(truncated.valid());
+}
+
+static volatile uint32_t sink;
+
+static double nsPer(std::chrono::steady_clock::time_point start, uint32_t ops) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ops;
+}
+
+void test_benchmark_encode_decode() {
+    const uint32_t iterations = 500000;
+    const uint8_t climate = SENSOR_FLAG_BME | SENSOR_FLAG_LUX | SENSOR_FLAG_SOIL;
+    SensorSample s = sampleOf(climate, 3.7f, 21.37f, 45.6f, 1013.2f, 123.4f, 57.0f, false);
+    uint8_t frame[DATA_V2_MAX_SIZE];
+    size_t len = 0;
+    uint32_t check = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        s.batteryMv = 3000 + (i & 1023);
+        len = encodeDataV2(s, (uint16_t)i, frame);
+        check += frame[len - 1];
+    }
+    double encodeNs = nsPer(start, iterations);
+
+    SensorSample out;
+    uint16_t seq;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        frame[2] = (uint8_t)i; // Defeat hoisting
+        if (decodeDataV2(frame, len, out, seq)) check += out.batteryMv + seq;
+    }
+    double decodeNs = nsPer(start, iterations);
+
+    // Gateway -> Transmitter: link record around the v2 frame, COBS + CRC
+    const uint8_t mac[6] = {0x24, 0x6F, 0x28, 1, 2, 3};
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    uint8_t wire[LINK_MAX_ENCODED];
+    size_t wireLen = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        size_t n = linkBuildRecord(1 + (i & 31), mac, frame, len, payload);
+        wireLen = linkEncodeFrame(LINK_FRAME_RECORD, (uint16_t)i, payload, n, wire, sizeof(wire));
+        check += wire[wireLen - 2];
+    }
+    double linkEncodeNs = nsPer(start, iterations);
+
+    LinkFrameParser parser;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        for (size_t k = 0; k < wireLen; k++) {
+            if (parser.push(wire[k])) check += parser.length();
+        }
+    }
+    double linkDecodeNs = nsPer(start, iterations);
+    TEST_ASSERT_EQUAL(iterations, parser.frames);
+    sink = check;
+
+    char msg[200];
+    snprintf(msg, sizeof(msg), "v2 frame %u B (v1 %u B): encode %.1f ns, decode %.1f ns; link frame %u B: encode %.1f ns, parse %.1f ns",
+             (unsigned)len, (unsigned)sizeof(DataMessage), encodeNs, decodeNs, (unsigned)wireLen, linkEncodeNs, linkDecodeNs);
+    TEST_MESSAGE(msg);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_accuracy);
+    RUN_TEST(test_clamps_out_of_range);
+    RUN_TEST(test_frame_sizes);
+    RUN_TEST(test_decode_rejects_bad_frames);
+    RUN_TEST(test_batch_round_trip);
+    RUN_TEST(test_benchmark_encode_decode);
+    return UNITY_END();
+}
@@ -0,0 +1,164 @@
+#include <unity.h>
+#include "serial_link.h"
+
+// Host tests for the Gateway -> Transmitter link codec: pio test -e native
+
+void setUp() {}
+void tearDown() {}
+
+// Feeds a whole wire frame to the parser, returns true if it completed a frame
+static bool feed(LinkFrameParser& parser, const uint8_t* wire, size_t len) {
+    bool done = false;
+    for (size_t i = 0; i < len; i++) done = parser.push(wire[i]);
+    return done;
+}
+
+static void cobsRoundTrip(const uint8_t* in, size_t len) {
+    uint8_t enc[LINK_MAX_ENCODED];
+    uint8_t dec[LINK_MAX_ENCODED];
+    size_t n = cobsEncode(in, len, enc);
+    TEST_ASSERT_LESS_OR_EQUAL(len + len / 254 + 1, n);
+    for (size_t i = 0; i < n; i++) TEST_ASSERT_TRUE(enc[i] != 0);
+    TEST_ASSERT_EQUAL(len, cobsDecode(enc, n, dec));
+    TEST_ASSERT_EQUAL_MEMORY(in, dec, len);
+}
+
+void test_crc16_check_value() {
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, crc16Ccitt(check, sizeof(check)));
+}
+
+void test_cobs_round_trip() {
+    const uint8_t zeros[] = {0, 0, 0};
+    const uint8_t mixed[] = {0x11, 0x00, 0x22, 0x33, 0x00};
+    cobsRoundTrip(zeros, sizeof(zeros));
+    cobsRoundTrip(mixed, sizeof(mixed));
+
+    // Runs of non-zero bytes either side of the 254 byte block limit
+    const size_t lens[] = {253, 254, 255, 300};
+    uint8_t run[300];
+    for (size_t len : lens) {
+        for (size_t i = 0; i < len; i++) run[i] = (uint8_t)(i % 255 + 1);
+        cobsRoundTrip(run, len);
+    }
+}
+
+void test_cobs_rejects_malformed() {
+    const uint8_t overrun[] = {0x05, 0x11, 0x22};
+    const uint8_t embeddedZero[] = {0x02, 0x11, 0x00};
+    uint8_t out[8];
+    TEST_ASSERT_EQUAL(0, cobsDecode(overrun, sizeof(overrun), out));
+    TEST_ASSERT_EQUAL(0, cobsDecode(embeddedZero, sizeof(embeddedZero), out));
+}
+
+void test_frame_round_trip() {
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    for (size_t i = 0; i < sizeof(payload); i++) payload[i] = (uint8_t)(i * 7); // Includes zeros
+    uint8_t wire[LINK_MAX_ENCODED];
+    LinkFrameParser parser;
+
+    const size_t lens[] = {0, 1, 42, LINK_MAX_PAYLOAD};
+    for (size_t len : lens) {
+        size_t n = linkEncodeFrame(LINK_FRAME_RECORD, 0xBEEF, payload, len, wire, sizeof(wire));
+        TEST_ASSERT_GREATER_THAN(0, n);
+        TEST_ASSERT_EQUAL_HEX8(0, wire[n - 1]);
+        TEST_ASSERT_TRUE(feed(parser, wire, n));
+        TEST_ASSERT_EQUAL(LINK_FRAME_RECORD, parser.type());
+        TEST_ASSERT_EQUAL_HEX16(0xBEEF, parser.seq());
+        TEST_ASSERT_EQUAL(len, parser.length());
+        if (len > 0) TEST_ASSERT_EQUAL_MEMORY(payload, parser.payload(), len);
+    }
+    TEST_ASSERT_EQUAL(4, parser.frames);
+    TEST_ASSERT_EQUAL(0, linkEncodeFrame(LINK_FRAME_RECORD, 1, payload, LINK_MAX_PAYLOAD + 1, wire, sizeof(wire)));
+    TEST_ASSERT_EQUAL(0, linkEncodeFrame(LINK_FRAME_RECORD, 1, payload, 42, wire, 40));
+}
+
+void test_parser_counts_corruption() {
+    const uint8_t payload[] = {1, 2, 3, 4};
+    uint8_t wire[LINK_MAX_ENCODED];
+    size_t n = linkEncodeFrame(LINK_FRAME_JSON, 0x0107, payload, sizeof(payload), wire, sizeof(wire));
+    LinkFrameParser parser;
+
+    TEST_ASSERT_EQUAL(n - 1, wire[0]); // No zeros, so wire[0] is the only COBS code
+    wire[5] ^= 0x40;                   // Flip a payload bit, keeping it non-zero
+    TEST_ASSERT_FALSE(feed(parser, wire, n));
+    TEST_ASSERT_EQUAL(1, parser.crcErrors);
+
+    const uint8_t shortFrame[] = {0x02, 0x11, 0x00};
+    TEST_ASSERT_FALSE(feed(parser, shortFrame, sizeof(shortFrame)));
+    TEST_ASSERT_EQUAL(1, parser.decodeErrors);
+
+    for (size_t i = 0; i < LINK_MAX_ENCODED + 1; i++) parser.push(0x55);
+    TEST_ASSERT_FALSE(parser.push(0));
+    TEST_ASSERT_EQUAL(1, parser.overflows);
+    TEST_ASSERT_EQUAL(0, parser.frames);
+}
+
+void test_parser_resyncs_mid_stream() {
+    const uint8_t payload[] = {0x10, 0x00, 0x20};
+    uint8_t wire[LINK_MAX_ENCODED];
+    size_t n = linkEncodeFrame(LINK_FRAME_RECORD, 3, payload, sizeof(payload), wire, sizeof(wire));
+    LinkFrameParser parser;
+
+    // Joined in the middle of a frame: the tail is rejected, the next frame decodes
+    TEST_ASSERT_FALSE(feed(parser, wire + 2, n - 2));
+    TEST_ASSERT_TRUE(feed(parser, wire, n));
+    TEST_ASSERT_EQUAL(3, parser.seq());
+    TEST_ASSERT_EQUAL_MEMORY(payload, parser.payload(), sizeof(payload));
+}
+
+void test_record_round_trip() {
+    const uint8_t mac[6] = {0x24, 0x6F, 0x28, 0x00, 0xAB, 0xCD};
+    const uint8_t packet[] = {0x05, 0x02, 0x00, 0x01};
+    uint8_t out[LINK_MAX_PAYLOAD];
+    LinkRecord rec;
+
+    size_t n = linkBuildRecord(12, mac, packet, sizeof(packet), out);
+    TEST_ASSERT_EQUAL(2 + sizeof(packet), n);
+    TEST_ASSERT_TRUE(linkParseRecord(out, n, rec));
+    TEST_ASSERT_EQUAL(12, rec.id);
+    TEST_ASSERT_NULL(rec.mac);
+    TEST_ASSERT_EQUAL(sizeof(packet), rec.packetLen);
+    TEST_ASSERT_EQUAL_MEMORY(packet, rec.packet, sizeof(packet));
+
+    // Id 0 carries the MAC
+    n = linkBuildRecord(0, mac, packet, sizeof(packet), out);
+    TEST_ASSERT_TRUE(linkParseRecord(out, n, rec));
+    TEST_ASSERT_EQUAL(0, rec.id);
+    TEST_ASSERT_EQUAL_MEMORY(mac, rec.mac, 6);
+    TEST_ASSERT_EQUAL_MEMORY(packet, rec.packet, sizeof(packet));
+
+    TEST_ASSERT_FALSE(linkParseRecord(out, 8, rec)); // Id 0 without a packet
+    uint8_t big[LINK_MAX_PAYLOAD];
+    TEST_ASSERT_EQUAL(0, linkBuildRecord(1, mac, big, LINK_MAX_PAYLOAD - 1, out));
+}
+
+void test_device_round_trip() {
+    const uint8_t mac[6] = {1, 2, 3, 4, 5, 6};
+    uint8_t out[LINK_MAX_PAYLOAD];
+    LinkDevice dev;
+
+    size_t n = linkBuildDevice(3, mac, "Living Room", out);
+    TEST_ASSERT_TRUE(linkParseDevice(out, n, dev));
+    TEST_ASSERT_EQUAL(3, dev.id);
+    TEST_ASSERT_EQUAL_MEMORY(mac, dev.mac, 6);
+    TEST_ASSERT_EQUAL(11, dev.nameLen);
+    TEST_ASSERT_EQUAL_STRING_LEN("Living Room", dev.name, 11);
+
+    TEST_ASSERT_FALSE(linkParseDevice(out, n - 1, dev)); // Truncated name
+    n = linkBuildDevice(0, mac, "x", out);
+    TEST_ASSERT_FALSE(linkParseDevice(out, n, dev));     // Id 0 is never announced
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_crc16_check_value);
+    RUN_TEST(test_cobs_round_trip);
+    RUN_TEST(test_cobs_rejects_malformed);
+    RUN_TEST(test_frame_round_trip);
+    RUN_TEST(test_parser_counts_corruption);
+    RUN_TEST(test_parser_resyncs_mid_stream);
+    RUN_TEST(test_record_round_trip);
+    RUN_TEST(test_device_round_trip);
+    return UNITY_END();
+}
@@ -0,0 +1,150 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include "spsc_ring.h"
+
+// Multithreaded stress test and throughput benchmark of SpscByteRing: one
+// thread plays the ESP-NOW callback, the other loop().
+
+void setUp() {}
+void tearDown() {}
+
+static const uint32_t STRESS_RECORDS = 2000000;
+static const uint8_t MIN_RECORD = 20; // Sizes of the ESP-NOW packets we queue
+static const uint8_t MAX_RECORD = 42;
+
+// [seq 4][filler derived from seq], MIN_RECORD..MAX_RECORD bytes
+static uint16_t makeRecord(uint32_t seq, uint8_t* out) {
+    uint16_t len = MIN_RECORD + seq % (MAX_RECORD - MIN_RECORD + 1);
+    memcpy(out, &seq, 4);
+    for (uint16_t i = 4; i < len; i++) out[i] = (uint8_t)(seq * 31 + i);
+    return len;
+}
+
+static bool checkRecord(const uint8_t* rec, uint16_t len, uint32_t& seq) {
+    memcpy(&seq, rec, 4);
+    uint8_t expect[MAX_RECORD];
+    return len == makeRecord(seq, expect) && memcmp(rec, expect, len) == 0;
+}
+
+struct StressResult {
+    uint32_t received = 0;
+    uint32_t corrupt = 0;
+    uint32_t outOfOrder = 0;
+};
+
+// Pushes STRESS_RECORDS while another thread drains; every record that comes
+// out must be intact and in order, and every record must be either received
+// or counted as an overflow.
+template <typename Ring>
+static StressResult stress(Ring& ring) {
+    StressResult r;
+    std::atomic<bool> producerDone{false};
+
+    std::thread consumer([&] {
+        uint8_t rec[MAX_RECORD];
+        int64_t last = -1;
+        for (;;) {
+            bool finished = producerDone.load(std::memory_order_acquire);
+            uint16_t len = ring.pop(rec, sizeof(rec));
+            if (len == 0) {
+                if (finished) break;
+                continue;
+            }
+            uint32_t seq;
+            if (!checkRecord(rec, len, seq)) { r.corrupt++; continue; }
+            if ((int64_t)seq <= last) r.outOfOrder++;
+            last = seq;
+            r.received++;
+        }
+    });
+
+    uint8_t rec[MAX_RECORD];
+    for (uint32_t seq = 0; seq < STRESS_RECORDS; seq++) {
+        uint16_t len = makeRecord(seq, rec);
+        ring.push(rec, 8, rec + 8, len - 8); // Header + body, as the Gateway pushes them
+    }
+    producerDone.store(true, std::memory_order_release);
+    consumer.join();
+    return r;
+}
+
+void test_stress_drop_newest() {
+    static SpscByteRing<1024, RING_DROP_NEWEST> ring;
+    StressResult r = stress(ring);
+    TEST_ASSERT_EQUAL(0, r.corrupt);
+    TEST_ASSERT_EQUAL(0, r.outOfOrder);
+    TEST_ASSERT_EQUAL(STRESS_RECORDS, r.received + ring.overflows());
+    TEST_ASSERT_LESS_OR_EQUAL(ring.capacity(), ring.highWater());
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_stress_drop_oldest() {
+    static SpscByteRing<1024, RING_DROP_OLDEST> ring;
+    StressResult r = stress(ring);
+    TEST_ASSERT_EQUAL(0, r.corrupt);
+    TEST_ASSERT_EQUAL(0, r.outOfOrder);
+    TEST_ASSERT_EQUAL(STRESS_RECORDS, r.received + ring.overflows());
+    TEST_ASSERT_LESS_OR_EQUAL(ring.capacity(), ring.highWater());
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_wrap_and_oversize() {
+    SpscByteRing<64> ring;
+    uint8_t in[40];
+    uint8_t out[40];
+    for (uint8_t i = 0; i < sizeof(in); i++) in[i] = i + 1;
+    for (int round = 0; round < 10; round++) { // 42 byte records walk across the 64 byte boundary
+        TEST_ASSERT_TRUE(ring.push(in, sizeof(in)));
+        TEST_ASSERT_FALSE(ring.push(in, sizeof(in))); // No room for a second one
+        TEST_ASSERT_EQUAL(sizeof(in), ring.pop(out, sizeof(out)));
+        TEST_ASSERT_EQUAL_MEMORY(in, out, sizeof(in));
+    }
+    TEST_ASSERT_FALSE(ring.push(in, 63));
+    TEST_ASSERT_EQUAL(11, ring.overflows());
+    TEST_ASSERT_EQUAL(0, ring.pop(out, sizeof(out)));
+}
+
+// Throughput with the Gateway's 4 KB ring and 32 byte packets, producer and
+// consumer on separate threads. Informational: nothing is asserted about speed.
+void test_benchmark_throughput() {
+    static SpscByteRing<4096, RING_DROP_NEWEST> ring;
+    const uint32_t records = 2000000;
+    uint8_t packet[32] = {1};
+    std::atomic<bool> producerDone{false};
+    uint32_t received = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&] {
+        uint8_t out[32];
+        for (;;) {
+            bool finished = producerDone.load(std::memory_order_acquire);
+            if (ring.pop(out, sizeof(out))) received++;
+            else if (finished) break;
+            else std::this_thread::yield();
+        }
+    });
+    for (uint32_t i = 0; i < records; i++) {
+        while (!ring.push(packet, sizeof(packet))) std::this_thread::yield(); // Wait instead of dropping
+    }
+    producerDone.store(true, std::memory_order_release);
+    consumer.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%u x 32 B records in %.3f s: %.1f M records/s, %.0f MB/s; 4 KB holds %u (vs 15 fixed 257 B slots)",
+             records, secs, records / secs / 1e6, records * 32.0 / secs / 1e6,
+             ring.capacity() / (unsigned)(SpscByteRing<4096>::HEADER_SIZE + sizeof(packet)));
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL(records, received);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_wrap_and_oversize);
+    RUN_TEST(test_stress_drop_newest);
+    RUN_TEST(test_stress_drop_oldest);
+    RUN_TEST(test_benchmark_throughput);
+    return UNITY_END();
+}
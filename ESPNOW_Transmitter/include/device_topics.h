@@ -0,0 +1,92 @@
+#ifndef DEVICE_TOPICS_H
+#define DEVICE_TOPICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "device_registry.h" // DEVICE_NAME_LEN, slugifyInto
+
+// MQTT topics of each device, built once instead of for every message.
+//
+// Indexed by the device id the Gateway assigns (see LINK_FRAME_DEVICE in
+// serial_link.h): an announce stores the MAC and name and formats the topics,
+// after which records only carry the id. Nothing is allocated.
+//
+// This header has no Arduino dependencies so it can be compiled on the host.
+
+#define DEVICE_TOPIC_MAX 48 // "<base>/<slug>/status" for a 31 character slug under "espnow"
+
+struct DeviceTopics {
+    uint8_t mac[6];
+    uint8_t nameLen;    // 0 = id not announced
+    uint8_t prefixLen;  // Length of "<base>/<slug>/", shared by all topics of the device
+    char name[DEVICE_NAME_LEN];
+    char state[DEVICE_TOPIC_MAX];
+    char status[DEVICE_TOPIC_MAX];
+};
+
+/**
+ * Fills `t` for the device called `name` (`len` bytes, not NUL-terminated).
+ */
+inline void deviceTopicsFill(DeviceTopics& t, const char* base, const uint8_t* mac,
+                             const char* name, size_t len) {
+    if (len > DEVICE_NAME_LEN - 1) len = DEVICE_NAME_LEN - 1;
+    memcpy(t.mac, mac, 6);
+    t.nameLen = (uint8_t)len;
+    memcpy(t.name, name, len);
+    t.name[len] = '\0';
+
+    char slug[DEVICE_NAME_LEN];
+    slugifyInto(t.name, slug, sizeof(slug));
+    int n = snprintf(t.state, sizeof(t.state), "%s/%s/", base, slug);
+    t.prefixLen = n < (int)sizeof(t.state) ? (uint8_t)n : sizeof(t.state) - 1;
+    memcpy(t.status, t.state, t.prefixLen);
+    snprintf(t.state + t.prefixLen, sizeof(t.state) - t.prefixLen, "state");
+    snprintf(t.status + t.prefixLen, sizeof(t.status) - t.prefixLen, "status");
+}
+
+template <uint16_t Capacity>
+class DeviceTopicTable {
+public:
+    explicit DeviceTopicTable(const char* base) : _base(base) { clear(); }
+
+    void clear() {
+        memset(_entries, 0, sizeof(_entries));
+    }
+
+    /**
+     * Applies an announce. Returns false if `id` is out of range.
+     */
+    bool set(uint16_t id, const uint8_t* mac, const char* name, size_t len) {
+        if (id == 0 || id > Capacity) return false;
+        deviceTopicsFill(_entries[id - 1], _base, mac, name, len);
+        return true;
+    }
+
+    /**
+     * Entry for `id`, or nullptr if it has not been announced.
+     */
+    const DeviceTopics* get(uint16_t id) const {
+        if (id == 0 || id > Capacity || _entries[id - 1].nameLen == 0) return nullptr;
+        return &_entries[id - 1];
+    }
+
+    /**
+     * Linear search, for the few messages that name a device instead of
+     * carrying its id. Returns nullptr if no announced device has that name.
+     */
+    const DeviceTopics* findByName(const char* name) const {
+        for (uint16_t i = 0; i < Capacity; i++) {
+            const DeviceTopics& t = _entries[i];
+            if (t.nameLen > 0 && strcmp(t.name, name) == 0) return &t;
+        }
+        return nullptr;
+    }
+
+private:
+    const char* _base;
+    DeviceTopics _entries[Capacity];
+};
+
+#endif
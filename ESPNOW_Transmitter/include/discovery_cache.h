@@ -0,0 +1,70 @@
+#ifndef DISCOVERY_CACHE_H
+#define DISCOVERY_CACHE_H
+
+#include <Arduino.h>
+#include "device_registry.h"
+#include "ha_discovery.h"
+
+// Persistent record of what discovery has been published for each device.
+//
+// Each entry keeps the values the discovery payload is built from plus a
+// fingerprint over them. A CONFIG whose fingerprint matches the cache is not
+// republished, so a Transmitter reboot no longer triggers a discovery storm,
+// while a real change (name, MAC, sensorFlags, interval) is republished at once.
+// The cache is stored in LittleFS as a small binary file. Changes only mark
+// it dirty; flush() writes it once from loop(), outside the publish scheduler.
+
+#define DISCOVERY_CACHE_SIZE 64
+#define DISCOVERY_CACHE_FILE "/discovery_cache.bin"
+
+struct CachedDevice {
+    char name[DEVICE_NAME_LEN];
+    char slug[DEVICE_NAME_LEN];
+    char mac[18];
+    uint8_t sensorFlags;
+    uint16_t expireAfter;
+    uint8_t format;      // DISCOVERY_FORMAT the entry was published in
+    uint32_t fingerprint;
+};
+
+/**
+ * Hash of everything that ends up in the discovery payload, including the
+ * discovery format so switching HA_DEVICE_DISCOVERY republishes too.
+ * DISCOVERY_TABLE_VERSION is included, so entity table changes do as well.
+ */
+uint32_t discoveryFingerprint(const DiscoveryDevice& dev);
+
+class DiscoveryCache {
+public:
+    void load();
+
+    // True if discovery for this device was published with identical values
+    bool isCurrent(const DiscoveryDevice& dev) const;
+
+    // True if the device has no entry or was published in the other format,
+    // so the other format's retained configs may still be on the broker
+    bool needsMigration(const char* slug) const;
+
+    // Records a successful publish; an unchanged entry is left alone
+    void store(const DiscoveryDevice& dev);
+
+    // Drops one device (by slug) so its next CONFIG republishes discovery
+    void forget(const char* slug);
+
+    // Writes the cache to LittleFS if store() or forget() changed it
+    void flush();
+
+    uint8_t size() const { return _count; }
+    const CachedDevice& at(uint8_t i) const { return _entries[i]; }
+    DiscoveryDevice toDevice(uint8_t i) const;
+
+private:
+    int indexOf(const char* slug) const;
+    void save() const;
+
+    CachedDevice _entries[DISCOVERY_CACHE_SIZE];
+    uint8_t _count = 0;
+    bool _dirty = false;
+};
+
+#endif
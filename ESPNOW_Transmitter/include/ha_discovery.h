@@ -0,0 +1,110 @@
+#ifndef HA_DISCOVERY_H
+#define HA_DISCOVERY_H
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include "protocol.h"
+
+// Home Assistant MQTT discovery, driven by a constant entity table.
+// Payloads are streamed straight into PubSubClient (beginPublish/write/endPublish);
+// no JsonDocument or full-size payload buffer is built.
+//
+// Two formats are supported:
+//  - per-entity: one retained homeassistant/<component>/<slug>/<key>/config per entity
+//  - device-based (HA_DEVICE_DISCOVERY): a single retained
+//    homeassistant/device/<slug>/config whose "cmps" map holds every entity
+//
+// When a device is migrated from the other format (see DiscoveryCache), its
+// retained configs in that format are cleared first so a broker that still
+// holds them does not give Home Assistant duplicate uniq_ids.
+
+#ifdef HA_DEVICE_DISCOVERY
+#define DISCOVERY_FORMAT 2
+#else
+#define DISCOVERY_FORMAT 1
+#endif
+
+enum EntityKind : uint8_t {
+    ENTITY_SENSOR,  // stat_t + val_tpl + stat_cla measurement
+    ENTITY_BINARY,  // stat_t + val_tpl
+    ENTITY_BUTTON,  // cmd_t + pl_prs
+    ENTITY_DIAGNOSTIC // stat_t .../diag + val_tpl, ent_cat diagnostic, never expires
+};
+
+struct EntityDesc {
+    const char* component;   // HA component ("sensor", "binary_sensor", "button")
+    const char* key;         // Topic segment and uniq_id suffix
+    const char* name;        // Short name, HA prepends the device name
+    const char* devClass;    // dev_cla (nullptr = omit)
+    const char* unit;        // unit_of_meas (nullptr = omit)
+    const char* value;       // val_tpl for sensors, pl_prs for buttons
+    const char* icon;        // ic (nullptr = omit)
+    uint8_t requiredFlags;   // SENSOR_FLAG_* the device must report (0 = always)
+    EntityKind kind;
+};
+
+constexpr EntityDesc DISCOVERY_ENTITIES[] = {
+    { "sensor", "battery", "Battery", "voltage", "V", "{{ value_json.batteryVoltage | round(2) }}", nullptr, 0, ENTITY_SENSOR },
+    { "sensor", "temperature", "Temperature", "temperature", "°C", "{{ value_json.temperature | round(1) }}", nullptr, SENSOR_FLAG_BME, ENTITY_SENSOR },
+    { "sensor", "humidity", "Humidity", "humidity", "%", "{{ value_json.humidity | round(1) }}", nullptr, SENSOR_FLAG_BME, ENTITY_SENSOR },
+    { "sensor", "pressure", "Pressure", "pressure", "hPa", "{{ value_json.pressure | round(1) }}", nullptr, SENSOR_FLAG_BME, ENTITY_SENSOR },
+    { "sensor", "lux", "Illuminance", "illuminance", "lx", "{{ value_json.lux | round(1) }}", nullptr, SENSOR_FLAG_LUX, ENTITY_SENSOR },
+    { "sensor", "soil", "Soil Moisture", "moisture", "%", "{{ value_json.soil | round(1) }}", nullptr, SENSOR_FLAG_SOIL, ENTITY_SENSOR },
+    { "binary_sensor", "binary", "Binary Sensor", nullptr, nullptr, "{{ 'ON' if value_json.binaryState else 'OFF' }}", nullptr, SENSOR_FLAG_BINARY, ENTITY_BINARY },
+    { "button", "restart", "Restart Device", nullptr, nullptr, "{\"cmd\": \"restart\"}", "mdi:restart", 0, ENTITY_BUTTON },
+    { "button", "ota", "Wake Up / OTA", nullptr, nullptr, "{\"cmd\": \"ota\"}", "mdi:cloud-upload", 0, ENTITY_BUTTON },
+    { "button", "calibrate", "Calibrate Soil Sensor", nullptr, nullptr, "{\"cmd\": \"calibrate\"}", "mdi:water-percent", SENSOR_FLAG_SOIL, ENTITY_BUTTON },
+    // Wake-cycle profile, published every PROFILE_REPORT_EVERY wakes as [min, avg, max] ms per phase
+    { "sensor", "awake_avg", "Awake Time", "duration", "ms", "{{ value_json.awake[1] }}", "mdi:timer-outline", 0, ENTITY_DIAGNOSTIC },
+    { "sensor", "awake_max", "Awake Time Max", "duration", "ms", "{{ value_json.awake[2] }}", "mdi:timer-alert-outline", 0, ENTITY_DIAGNOSTIC },
+    { "sensor", "boot_avg", "Boot Time", "duration", "ms", "{{ value_json.boot[1] }}", "mdi:timer-outline", 0, ENTITY_DIAGNOSTIC },
+    { "sensor", "read_avg", "Sensor Read Time", "duration", "ms", "{{ value_json.read[1] }}", "mdi:timer-outline", 0, ENTITY_DIAGNOSTIC },
+    { "sensor", "send_avg", "Send Time", "duration", "ms", "{{ value_json.sendData[1] }}", "mdi:timer-outline", 0, ENTITY_DIAGNOSTIC },
+};
+
+// Bump whenever DISCOVERY_ENTITIES changes so cached discovery is republished
+#define DISCOVERY_TABLE_VERSION 2
+
+constexpr uint8_t DISCOVERY_ENTITY_COUNT = sizeof(DISCOVERY_ENTITIES) / sizeof(DISCOVERY_ENTITIES[0]);
+
+/**
+ * Per-device values shared by every entity of that device.
+ */
+struct DiscoveryDevice {
+    const char* name;       // Pretty device name
+    const char* slug;       // slugify(name)
+    const char* mac;        // "AA:BB:CC:DD:EE:FF" or "" if unknown
+    uint8_t sensorFlags;
+    uint16_t expireAfter;   // exp_aft in seconds
+};
+
+#define DISCOVERY_UID_LEN 33
+
+inline bool entityEnabled(const EntityDesc& e, uint8_t sensorFlags) {
+    return (e.requiredFlags & sensorFlags) == e.requiredFlags;
+}
+
+/**
+ * Builds the discovery topic for an entity into `out`.
+ */
+void discoveryTopic(const DiscoveryDevice& dev, const EntityDesc& e, char* out, size_t cap);
+
+void deviceDiscoveryTopic(const DiscoveryDevice& dev, char* out, size_t cap);
+
+/**
+ * Publishes one retained entity config. Returns false if the publish failed.
+ */
+bool publishEntityDiscovery(PubSubClient& client, const DiscoveryDevice& dev, const EntityDesc& e);
+
+/**
+ * Publishes the retained device-based config carrying all enabled entities.
+ */
+bool publishDeviceDiscovery(PubSubClient& client, const DiscoveryDevice& dev);
+
+/**
+ * Clears a retained config with an empty retained message.
+ */
+bool clearEntityDiscovery(PubSubClient& client, const DiscoveryDevice& dev, const EntityDesc& e);
+bool clearDeviceDiscovery(PubSubClient& client, const DiscoveryDevice& dev);
+
+#endif
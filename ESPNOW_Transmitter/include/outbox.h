@@ -0,0 +1,69 @@
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <Arduino.h>
+#include "publish_scheduler.h"
+
+// Store-and-forward buffer for state messages while the broker is unreachable.
+//
+// Messages first go to a small RAM ring. Once that is full, or as soon as the
+// segment file holds anything (so ordering is preserved), they are appended to
+// an append-only LittleFS segment. Replay drains RAM first, then the segment,
+// oldest first. Each entry keeps its original receive time so the replayed
+// payload can carry a "ts" (epoch seconds) field.
+
+#define OUTBOX_RAM_SLOTS      8
+#define OUTBOX_FILE           "/outbox.seg"
+#define OUTBOX_MAX_FILE_BYTES (64 * 1024)
+
+struct OutboxEntry {
+    uint32_t rxEpoch;   // Epoch seconds at receive (0 if the clock was not set)
+    uint32_t rxMillis;  // millis() at receive (only meaningful in the same boot)
+    char topic[PUBLISH_TOPIC_MAX];
+    char payload[PUBLISH_PAYLOAD_MAX];
+    uint16_t len;
+};
+
+struct OutboxStats {
+    uint32_t spilled;   // Entries written to the segment file
+    uint32_t replayed;  // Entries handed back for publishing
+    uint32_t dropped;   // Entries lost because RAM and file were full
+};
+
+class Outbox {
+public:
+    // Picks up a segment left over from a previous boot, cut back to its last complete record
+    void begin();
+
+    bool push(const char* topic, const char* payload, size_t len, uint32_t rxEpoch, uint32_t rxMillis);
+
+    /**
+     * Copies the oldest entry into `out` without removing it.
+     * `sameBoot` is false for entries written before this boot (rxMillis is stale).
+     */
+    bool peek(OutboxEntry& out, bool& sameBoot);
+    void pop();
+
+    bool empty() const { return _ramCount == 0 && !_fileActive; }
+    uint8_t ramDepth() const { return _ramCount; }
+    uint32_t fileBytes() const { return _fileActive ? _fileSize - _readPos : 0; }
+    const OutboxStats& stats() const { return _stats; }
+
+private:
+    bool appendToFile(const OutboxEntry& e);
+    bool readFileEntry(OutboxEntry& out, uint32_t& nextPos);
+
+    OutboxEntry _ram[OUTBOX_RAM_SLOTS];
+    uint8_t _ramHead = 0;
+    uint8_t _ramCount = 0;
+
+    bool _fileActive = false;
+    uint32_t _fileSize = 0;
+    uint32_t _readPos = 0;
+    uint32_t _staleBefore = 0;   // File offset below which entries predate this boot
+    uint32_t _peekNext = 0;      // File offset after the entry returned by peek()
+
+    OutboxStats _stats = {};
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef PUBLISH_SCHEDULER_H
+#define PUBLISH_SCHEDULER_H
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include "discovery_cache.h"
+#include "ha_discovery.h"
+
+// Cooperative MQTT publish scheduler.
+//
+// Outbound work is queued in bounded per-priority lanes instead of being
+// published inline. service() is called once per loop() pass and publishes
+// state first, then availability, then discovery (one entity or one device
+// payload per step; a migrating device first has the other format's retained
+// configs cleared, also one per step) until its time budget is spent. Whatever is left is
+// carried over to the next pass, so serial ingest is never starved.
+//
+// Messages can be rendered straight into a lane slot (reserve()/commit()) and
+// are streamed from the slot to the socket, so a state message is not copied
+// on its way from the serializer to the broker.
+
+#define PUBLISH_TOPIC_MAX    64
+#define PUBLISH_PAYLOAD_MAX  256
+#define STATE_LANE_SIZE      8
+#define AVAILABILITY_LANE_SIZE 4
+#define DISCOVERY_LANE_SIZE  8
+
+enum PublishLane : uint8_t {
+    LANE_STATE,
+    LANE_AVAILABILITY,
+    LANE_DISCOVERY,
+    LANE_COUNT
+};
+
+struct OutboundMessage {
+    char topic[PUBLISH_TOPIC_MAX];
+    char payload[PUBLISH_PAYLOAD_MAX];
+    uint16_t len;
+    bool retain;
+};
+
+struct DiscoveryJob {
+    CachedDevice dev;
+    uint8_t nextEntity;  // Next DISCOVERY_ENTITIES row to publish (per-entity) or clear (device-based)
+    bool cleared;        // Retained configs of the other format have been cleared
+    bool failed;
+};
+
+struct PublishStats {
+    uint8_t depth[LANE_COUNT];
+    uint8_t highWater[LANE_COUNT];
+    uint32_t dropped[LANE_COUNT];
+    uint32_t published;
+    uint32_t failed;
+    uint32_t deferred;       // service() passes that ran out of budget with work left
+    uint32_t maxServiceUs;
+};
+
+typedef void (*DiscoveryDoneCallback)(const DiscoveryDevice& dev, bool ok);
+typedef void (*StateFailedCallback)(const OutboundMessage& msg);
+
+class PublishScheduler {
+public:
+    explicit PublishScheduler(PubSubClient& client) : _client(client) {}
+
+    /**
+     * Queues a state or availability message. Returns false (and counts a
+     * drop) if the lane is full or the message does not fit a slot.
+     */
+    bool enqueue(PublishLane lane, const char* topic, const char* payload, size_t len, bool retain = false);
+    bool enqueue(PublishLane lane, const char* topic, const char* payload, bool retain = false) {
+        return enqueue(lane, topic, payload, strlen(payload), retain);
+    }
+
+    /**
+     * Hands out the next state or availability slot with its topic set, for
+     * the caller to fill in payload and len before commit(). Returns nullptr
+     * if the lane is full or the topic does not fit; that is not counted as a
+     * drop since the caller still holds the message.
+     */
+    OutboundMessage* reserve(PublishLane lane, const char* topic, bool retain = false);
+    void commit(PublishLane lane);
+
+    /**
+     * Queues discovery for a device; a pending job for the same slug is replaced.
+     * With `clearOther` the other format's retained configs are cleared first.
+     */
+    bool enqueueDiscovery(const DiscoveryDevice& dev, bool clearOther = false);
+
+    void onDiscoveryDone(DiscoveryDoneCallback cb) { _discoveryDone = cb; }
+
+    /**
+     * Called with a state message whose publish failed (e.g. the broker
+     * dropped mid-publish) before its slot is reused, so it can be kept.
+     */
+    void onStateFailed(StateFailedCallback cb) { _stateFailed = cb; }
+
+    /**
+     * Publishes queued work by priority until `budgetUs` has elapsed.
+     */
+    void service(uint32_t budgetUs);
+
+    bool idle() const { return _state.count == 0 && _availability.count == 0 && _discoveryCount == 0; }
+    bool hasRoom(PublishLane lane) const;
+    const PublishStats& stats() const { return _stats; }
+
+private:
+    template <uint8_t N>
+    struct MessageLane {
+        OutboundMessage items[N];
+        uint8_t head = 0;
+        uint8_t count = 0;
+    };
+
+    template <uint8_t N>
+    OutboundMessage* freeSlot(MessageLane<N>& q, const char* topic, bool retain);
+    template <uint8_t N>
+    void append(MessageLane<N>& q, PublishLane lane);
+    template <uint8_t N>
+    bool push(MessageLane<N>& q, PublishLane lane, const char* topic, const char* payload, size_t len, bool retain);
+    template <uint8_t N>
+    bool publishFront(MessageLane<N>& q, PublishLane lane);
+    bool stepDiscovery();
+    void noteDepth(PublishLane lane, uint8_t depth);
+
+    PubSubClient& _client;
+    MessageLane<STATE_LANE_SIZE> _state;
+    MessageLane<AVAILABILITY_LANE_SIZE> _availability;
+    DiscoveryJob _discovery[DISCOVERY_LANE_SIZE];
+    uint8_t _discoveryHead = 0;
+    uint8_t _discoveryCount = 0;
+    DiscoveryDoneCallback _discoveryDone = nullptr;
+    StateFailedCallback _stateFailed = nullptr;
+    PublishStats _stats = {};
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "discovery_cache.h"
+#include <LittleFS.h>
+
+static const uint32_t CACHE_MAGIC = 0x32304344; // "DC02"
+
+uint32_t discoveryFingerprint(const DiscoveryDevice& dev) {
+    uint32_t h = fnv1a32((const uint8_t*)dev.name, strlen(dev.name));
+    h = fnv1a32((const uint8_t*)dev.mac, strlen(dev.mac), h);
+    h = fnv1a32(&dev.sensorFlags, sizeof(dev.sensorFlags), h);
+    h = fnv1a32((const uint8_t*)&dev.expireAfter, sizeof(dev.expireAfter), h);
+    const uint8_t format = DISCOVERY_FORMAT;
+    const uint8_t table = DISCOVERY_TABLE_VERSION;
+    h = fnv1a32(&table, sizeof(table), h);
+    return fnv1a32(&format, sizeof(format), h);
+}
+
+void DiscoveryCache::load() {
+    _count = 0;
+    _dirty = false;
+    File f = LittleFS.open(DISCOVERY_CACHE_FILE, "r");
+    if (!f) return;
+    uint32_t magic = 0;
+    uint8_t count = 0;
+    if (f.read((uint8_t*)&magic, sizeof(magic)) == sizeof(magic) && magic == CACHE_MAGIC &&
+        f.read(&count, 1) == 1) {
+        if (count > DISCOVERY_CACHE_SIZE) count = DISCOVERY_CACHE_SIZE;
+        size_t bytes = count * sizeof(CachedDevice);
+        if (f.read((uint8_t*)_entries, bytes) == bytes) _count = count;
+    }
+    f.close();
+}
+
+void DiscoveryCache::save() const {
+    File f = LittleFS.open(DISCOVERY_CACHE_FILE, "w");
+    if (!f) return;
+    f.write((const uint8_t*)&CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    f.write(&_count, 1);
+    f.write((const uint8_t*)_entries, _count * sizeof(CachedDevice));
+    f.close();
+}
+
+int DiscoveryCache::indexOf(const char* slug) const {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (strcmp(_entries[i].slug, slug) == 0) return i;
+    }
+    return -1;
+}
+
+bool DiscoveryCache::isCurrent(const DiscoveryDevice& dev) const {
+    int i = indexOf(dev.slug);
+    return i >= 0 && _entries[i].fingerprint == discoveryFingerprint(dev);
+}
+
+bool DiscoveryCache::needsMigration(const char* slug) const {
+    int i = indexOf(slug);
+    return i < 0 || _entries[i].format != DISCOVERY_FORMAT;
+}
+
+void DiscoveryCache::store(const DiscoveryDevice& dev) {
+    int i = indexOf(dev.slug);
+    uint32_t fingerprint = discoveryFingerprint(dev);
+    // A replay after a HA birth message republishes what is already cached
+    if (i >= 0 && _entries[i].fingerprint == fingerprint && strcmp(_entries[i].name, dev.name) == 0 &&
+        strcmp(_entries[i].mac, dev.mac) == 0) {
+        return;
+    }
+    if (i < 0) {
+        if (_count >= DISCOVERY_CACHE_SIZE) return; // Not cached: republished on every CONFIG
+        i = _count++;
+    }
+    CachedDevice& e = _entries[i];
+    strlcpy(e.name, dev.name, sizeof(e.name));
+    strlcpy(e.slug, dev.slug, sizeof(e.slug));
+    strlcpy(e.mac, dev.mac, sizeof(e.mac));
+    e.sensorFlags = dev.sensorFlags;
+    e.expireAfter = dev.expireAfter;
+    e.format = DISCOVERY_FORMAT;
+    e.fingerprint = fingerprint;
+    _dirty = true;
+}
+
+void DiscoveryCache::forget(const char* slug) {
+    int i = indexOf(slug);
+    if (i < 0) return;
+    _entries[i] = _entries[--_count];
+    _dirty = true;
+}
+
+void DiscoveryCache::flush() {
+    if (!_dirty) return;
+    save();
+    _dirty = false;
+}
+
+DiscoveryDevice DiscoveryCache::toDevice(uint8_t i) const {
+    const CachedDevice& e = _entries[i];
+    DiscoveryDevice dev;
+    dev.name = e.name;
+    dev.slug = e.slug;
+    dev.mac = e.mac;
+    dev.sensorFlags = e.sensorFlags;
+    dev.expireAfter = e.expireAfter;
+    return dev;
+}
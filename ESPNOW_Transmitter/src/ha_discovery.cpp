@@ -0,0 +1,199 @@
+#include "ha_discovery.h"
+
+extern const char* mqtt_topic_base;
+
+namespace {
+
+/**
+ * Minimal JSON writer. With a null client it only counts bytes, which gives
+ * beginPublish() its length; the second pass streams the same bytes out
+ * through a small chunk buffer.
+ */
+class JsonStream {
+public:
+    explicit JsonStream(PubSubClient* client) : _client(client) {}
+
+    void beginObject(const char* key = nullptr) { if (key) writeKey(key); put('{'); _needComma = false; }
+    void endObject() { put('}'); _needComma = true; }
+    void beginArray(const char* key) { writeKey(key); put('['); _needComma = false; }
+    void endArray() { put(']'); _needComma = true; }
+
+    void field(const char* key, const char* value) { if (value) { writeKey(key); writeString(value); } }
+    void field(const char* key, int value) { writeKey(key); char num[12]; itoa(value, num, 10); raw(num); }
+    void field(const char* key, bool value) { writeKey(key); raw(value ? "true" : "false"); }
+    void item(const char* value) { comma(); writeString(value); }
+
+    // Writes a string value built from several parts, e.g. a topic or uniq_id
+    void fieldParts(const char* key, const char* a, const char* b = "", const char* c = "", const char* d = "") {
+        writeKey(key);
+        put('"'); escaped(a); escaped(b); escaped(c); escaped(d); put('"');
+    }
+
+    size_t length() const { return _length; }
+    void flush() { if (_client && _used) _client->write(_chunk, _used); _used = 0; }
+
+private:
+    void comma() { if (_needComma) put(','); _needComma = true; }
+    void writeKey(const char* key) { comma(); put('"'); raw(key); put('"'); put(':'); }
+    void writeString(const char* s) { put('"'); escaped(s); put('"'); }
+
+    void escaped(const char* s) {
+        for (; *s; s++) {
+            if (*s == '"' || *s == '\\') put('\\');
+            if ((uint8_t)*s < 0x20) continue; // Drop control characters
+            put(*s);
+        }
+    }
+
+    void raw(const char* s) { while (*s) put(*s++); }
+
+    void put(char c) {
+        _length++;
+        if (!_client) return;
+        _chunk[_used++] = (uint8_t)c;
+        if (_used == sizeof(_chunk)) flush();
+    }
+
+    PubSubClient* _client;
+    uint8_t _chunk[64];
+    size_t _used = 0;
+    size_t _length = 0;
+    bool _needComma = false;
+};
+
+void writeUniqueIdBase(const DiscoveryDevice& dev, char* out, size_t cap) {
+    if (dev.mac && dev.mac[0]) {
+        // MAC without colons
+        size_t n = 0;
+        for (const char* p = dev.mac; *p && n < cap - 1; p++) {
+            if (*p != ':') out[n++] = *p;
+        }
+        out[n] = '\0';
+    } else {
+        strlcpy(out, dev.name, cap);
+    }
+}
+
+// Entity options shared by the per-entity and the device-based formats
+void writeComponent(JsonStream& w, const DiscoveryDevice& dev, const EntityDesc& e, const char* uidBase) {
+    w.field("name", e.name);
+    if (e.kind == ENTITY_BUTTON) {
+        w.fieldParts("cmd_t", mqtt_topic_base, "/", dev.slug, "/control");
+        w.field("pl_prs", e.value);
+        w.fieldParts("uniq_id", uidBase, "_btn_", e.key);
+        w.field("ic", e.icon);
+        w.field("ret", false);
+    } else if (e.kind == ENTITY_DIAGNOSTIC) {
+        w.fieldParts("stat_t", mqtt_topic_base, "/", dev.slug, "/diag");
+        w.fieldParts("uniq_id", uidBase, "_", e.key);
+        w.field("val_tpl", e.value);
+        w.field("dev_cla", e.devClass);
+        w.field("unit_of_meas", e.unit);
+        w.field("ic", e.icon);
+        w.field("stat_cla", "measurement");
+        w.field("ent_cat", "diagnostic");
+    } else {
+        w.fieldParts("stat_t", mqtt_topic_base, "/", dev.slug, "/state");
+        w.fieldParts("uniq_id", uidBase, "_", e.key);
+        w.field("val_tpl", e.value);
+        w.field("exp_aft", (int)dev.expireAfter);
+        w.field("dev_cla", e.devClass);
+        w.field("unit_of_meas", e.unit);
+        w.field("ic", e.icon);
+        if (e.kind == ENTITY_SENSOR) w.field("stat_cla", "measurement");
+    }
+}
+
+void writeDeviceBlock(JsonStream& w, const DiscoveryDevice& dev) {
+    w.beginObject("dev");
+    w.beginArray("ids");
+    if (dev.mac && dev.mac[0]) w.item(dev.mac);
+    w.item(dev.name); // Fallback/Secondary ID
+    w.endArray();
+    w.field("name", dev.name);
+    w.field("mdl", "ESP-NOW Sensor");
+    w.field("mf", "Antigravity");
+    w.endObject();
+}
+
+void writeEntity(JsonStream& w, const DiscoveryDevice& dev, const EntityDesc& e) {
+    char uidBase[DISCOVERY_UID_LEN];
+    writeUniqueIdBase(dev, uidBase, sizeof(uidBase));
+
+    w.beginObject();
+    writeComponent(w, dev, e, uidBase);
+    writeDeviceBlock(w, dev);
+    w.endObject();
+}
+
+// Device-based discovery: one payload, every enabled entity under "cmps"
+void writeDevice(JsonStream& w, const DiscoveryDevice& dev) {
+    char uidBase[DISCOVERY_UID_LEN];
+    writeUniqueIdBase(dev, uidBase, sizeof(uidBase));
+
+    w.beginObject();
+    writeDeviceBlock(w, dev);
+    w.beginObject("o");
+    w.field("name", "ESPNOW Transmitter");
+    w.endObject();
+    w.beginObject("cmps");
+    for (const EntityDesc& e : DISCOVERY_ENTITIES) {
+        if (!entityEnabled(e, dev.sensorFlags)) continue;
+        w.beginObject(e.key);
+        w.field("p", e.component);
+        writeComponent(w, dev, e, uidBase);
+        w.endObject();
+    }
+    w.endObject();
+    w.endObject();
+}
+
+} // namespace
+
+void discoveryTopic(const DiscoveryDevice& dev, const EntityDesc& e, char* out, size_t cap) {
+    snprintf(out, cap, "homeassistant/%s/%s/%s/config", e.component, dev.slug, e.key);
+}
+
+void deviceDiscoveryTopic(const DiscoveryDevice& dev, char* out, size_t cap) {
+    snprintf(out, cap, "homeassistant/device/%s/config", dev.slug);
+}
+
+bool clearEntityDiscovery(PubSubClient& client, const DiscoveryDevice& dev, const EntityDesc& e) {
+    char topic[128];
+    discoveryTopic(dev, e, topic, sizeof(topic));
+    return client.beginPublish(topic, 0, true) && client.endPublish();
+}
+
+bool clearDeviceDiscovery(PubSubClient& client, const DiscoveryDevice& dev) {
+    char topic[128];
+    deviceDiscoveryTopic(dev, topic, sizeof(topic));
+    return client.beginPublish(topic, 0, true) && client.endPublish();
+}
+
+bool publishEntityDiscovery(PubSubClient& client, const DiscoveryDevice& dev, const EntityDesc& e) {
+    char topic[128];
+    discoveryTopic(dev, e, topic, sizeof(topic));
+
+    JsonStream counter(nullptr);
+    writeEntity(counter, dev, e);
+
+    if (!client.beginPublish(topic, counter.length(), true)) return false;
+    JsonStream out(&client);
+    writeEntity(out, dev, e);
+    out.flush();
+    return client.endPublish();
+}
+
+bool publishDeviceDiscovery(PubSubClient& client, const DiscoveryDevice& dev) {
+    char topic[128];
+    deviceDiscoveryTopic(dev, topic, sizeof(topic));
+
+    JsonStream counter(nullptr);
+    writeDevice(counter, dev);
+
+    if (!client.beginPublish(topic, counter.length(), true)) return false;
+    JsonStream out(&client);
+    writeDevice(out, dev);
+    out.flush();
+    return client.endPublish();
+}
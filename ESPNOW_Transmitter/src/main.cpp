@@ -1,16 +1,24 @@
 #include <Arduino.h>
-#include <SoftwareSerial.h>
 #include <ArduinoOTA.h>
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
 #include <WiFiManager.h>
 #include <LittleFS.h>
-#include <map>
-#include <vector>
 
+#include "link_port.h"
 #include "CommonUtils.h"
 #include "protocol.h"
+#include "protocol_v2.h"
+#include "serial_link.h"
+#include "device_registry.h"
+#include "ha_discovery.h"
+#include "discovery_cache.h"
+#include "publish_scheduler.h"
+#include "outbox.h"
+#include "device_topics.h"
+#include <stdarg.h>
+#include <time.h>
 
 // Forward declarations
 WiFiServer telnetServer(23);
@@ -18,21 +26,61 @@ WiFiClient telnetClient;
 bool isOTAUpdating = false;
 
 // Global log helper
-void log(const String& msg, bool newline = true) {
+void log(const char* msg, bool newline = true) {
     logToBoth(msg, newline, telnetClient);
 }
 
+void log(const String& msg, bool newline = true) {
+    log(msg.c_str(), newline);
+}
+
+// printf-style log for the per-message paths: formats on the stack, no String temporaries
+void logPrintf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+void logPrintf(const char* fmt, ...) {
+    char line[128];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    log(line);
+}
+
 MqttConfig mqtt_cfg;
 const char* mqtt_topic_base = "espnow"; 
 
-// Track discovered devices
-std::map<String, bool> discoveredDevices;
+// State/status topics per device id, filled in by the Gateway's announces
+DeviceTopicTable<LINK_MAX_DEVICE_ID> deviceTopics(mqtt_topic_base);
+DeviceTopics unknownDevice;       // Sender of id 0 records (not registered on the Gateway)
+uint32_t linkUnknownIds = 0;      // Records held back because their id was not announced yet
+
+// Reused for every link frame: JSON frames are parsed into it in place and
+// state messages are built in it, so ingest allocates nothing per message
+StaticJsonDocument<512> linkDoc;
+
+// Track discovered devices (persisted, survives reboot/OTA)
+DiscoveryCache discoveryCache;
 
 WiFiClient espClient;
 PubSubClient client(espClient);
-SoftwareSerial swSerial(D6, D5); // RX = D6, TX = D5
+LinkFrameParser linkParser;
+uint32_t serialOverflows = 0;
+
+// All MQTT output except connection bookkeeping goes through the scheduler
+const uint32_t PUBLISH_BUDGET_US = 3000;
+PublishScheduler scheduler(client);
+uint32_t stateOversize = 0; // State messages dropped for not fitting a lane slot
+uint8_t discoveryReplayNext = 0xFF; // Next cache entry to republish after HA birth (0xFF = none)
+
+// State messages received while the broker is unreachable are held here and replayed in order
+const unsigned long OUTBOX_REPLAY_INTERVAL_MS = 20; // 50 msg/s on reconnect
+Outbox outbox;
+MqttConfigPortal configPortal;
 bool shouldSaveConfig = false;
 
+// Gateway watchdog state
+unsigned long lastGatewayHeartbeat = 0;
+bool gatewayOnline = false;
+
 void saveConfigCallback() {
   shouldSaveConfig = true;
 }
@@ -54,6 +102,14 @@ void mqtt_callback(char* topic, byte* payload, unsigned int length) {
     message[length] = '\0';
     
     String topicStr = String(topic);
+    if (topicStr == "homeassistant/status") {
+        // HA birth message: it may have lost its retained configs, republish everything we know
+        if (strcmp(message, "online") == 0) {
+            log("Home Assistant online, republishing discovery for " + String(discoveryCache.size()) + " devices");
+            discoveryReplayNext = 0; // Fed into the scheduler from loop() as the lane drains
+        }
+        return;
+    }
     if (topicStr.startsWith("espnow/") && topicStr.endsWith("/control")) {
         int firstSlash = topicStr.indexOf('/');
         int lastSlash = topicStr.lastIndexOf('/');
@@ -70,12 +126,12 @@ void mqtt_callback(char* topic, byte* payload, unsigned int length) {
             String relayedJson;
             serializeJson(doc, relayedJson);
             log("Control for [" + topicDeviceName + "]: " + relayedJson);
-            swSerial.println(relayedJson);
+            linkSerial.println(relayedJson);
             
             if (doc["cmd"] == "send_config") {
                 String slugName = slugify(topicDeviceName);
                 log("Clearing discovery cache for: " + slugName);
-                discoveredDevices.erase(slugName);
+                discoveryCache.forget(slugName.c_str());
             }
 
             if (topicDeviceName == "transmitter") {
@@ -98,6 +154,7 @@ void mqtt_callback(char* topic, byte* payload, unsigned int length) {
 }
 
 void reconnect() {
+    if (configPortal.active()) return; // Portal owns WiFi until it closes
     static unsigned long lastReconnectAttempt = 0;
     unsigned long now = millis();
     if (now - lastReconnectAttempt < 5000) return;
@@ -114,6 +171,7 @@ void reconnect() {
                        "espnow/transmitter/state", 1, true, "{\"status\":\"offline\"}")) {
         log("✓ connected");
         client.subscribe("espnow/+/control");
+        client.subscribe("homeassistant/status");
         StaticJsonDocument<128> doc;
         doc["connection"] = WiFi.localIP().toString();
         doc["status"] = "online"; 
@@ -130,159 +188,446 @@ void reconnect() {
         mqttFailures++;
         log("✗ failed, rc=" + String(client.state()) + " (" + String(mqttFailures) + "/3)");
         if (mqttFailures >= 3) {
+            // Non-blocking: gateway ingest keeps running and state goes to the outbox
             log("Too many failures. Starting Config Portal...");
-            startMqttConfigPortal(mqtt_cfg, "ESPNOW-Transmitter");
+            configPortal.begin(mqtt_cfg, "ESPNOW-Transmitter");
             mqttFailures = 0;
         }
     }
 }
 
+void onDiscoveryPublished(const DiscoveryDevice& dev, bool ok) {
+    if (ok) {
+        log("✓ Published discovery for " + String(dev.name));
+        discoveryCache.store(dev);
+    } else {
+        log("✗ Failed to publish discovery for " + String(dev.name));
+    }
+}
+
 void publishDiscoveryWithMac(const JsonVariantConst& config, const char* macAddress) {
     const char* deviceName = config["deviceName"];
     if (deviceName == nullptr) return;
-    String slugName = slugify(deviceName);
-    if (discoveredDevices.count(slugName)) return;
+    char slug[DEVICE_NAME_LEN];
+    slugifyInto(deviceName, slug, sizeof(slug));
     
-    int sensorFlags = config["sensorFlags"] | 0;
     int sleepInterval = config["sleepInterval"] | 15; 
-    int expireAfter = (sleepInterval * 3) + 20;
-    // Use MAC as unique ID source if available, otherwise fallback to deviceName
-    String uniqueIdBase = String(deviceName);
-    if (macAddress && strlen(macAddress) > 0) {
-        uniqueIdBase = String(macAddress);
-        uniqueIdBase.replace(":", "");
+    int heartbeatInterval = config["heartbeatInterval"] | 0; // Report-on-change: longest silence
+
+    DiscoveryDevice dev;
+    dev.name = deviceName;
+    dev.slug = slug;
+    dev.mac = macAddress ? macAddress : "";
+    dev.sensorFlags = config["sensorFlags"] | 0;
+    // A report-on-change device may stay silent for a full heartbeat, plus slack for retried wakes
+    dev.expireAfter = heartbeatInterval + (sleepInterval * 3) + 20;
+
+    // Unchanged since the last successful publish: nothing to do
+    if (discoveryCache.isCurrent(dev)) return;
+
+    if (!scheduler.enqueueDiscovery(dev, discoveryCache.needsMigration(dev.slug))) {
+        log("✗ Discovery queue full, dropped: " + String(deviceName));
     }
+}
 
-    auto publishEntity = [&](const char* component, const char* entityKey, const char* name, 
-                             const char* devClass, const char* unit, const char* valTpl, 
-                             const char* statClass = "measurement") {
-        
-        DynamicJsonDocument doc(1024);
-        String discoveryTopic = String("homeassistant/") + component + "/" + slugify(deviceName) + "/" + entityKey + "/config";
-        
-        doc["name"] = name; // Short name, HA prepends device name
-        doc["stat_t"] = String(mqtt_topic_base) + "/" + slugify(deviceName) + "/state";
-        doc["uniq_id"] = uniqueIdBase + "_" + entityKey;
-        doc["val_tpl"] = valTpl;
-        doc["exp_aft"] = expireAfter;
-        if (devClass) doc["dev_cla"] = devClass;
-        if (unit) doc["unit_of_meas"] = unit;
-        if (statClass) doc["stat_cla"] = statClass;
-
-        JsonObject device = doc.createNestedObject("dev");
-        JsonArray identifiers = device.createNestedArray("ids");
-        if (macAddress && strlen(macAddress) > 0) identifiers.add(macAddress);
-        identifiers.add(deviceName); // Fallback/Secondary ID
-        device["name"] = deviceName;
-        device["mdl"] = "ESP-NOW Sensor";
-        device["mf"] = "Antigravity";
-
-        char buffer[1024];
-        serializeJson(doc, buffer);
-        if (client.publish(discoveryTopic.c_str(), buffer, true)) {
-            log("✓ Published discovery: " + discoveryTopic);
-        } else {
-            log("✗ Failed to publish discovery: " + discoveryTopic + " (Payload too large?)");
+bool clockValid() {
+    return time(nullptr) > 1600000000; // Set by NTP
+}
+
+// Serializes a state message straight into a state lane slot, or into the
+// outbox while the broker is down, the outbox still holds older messages, or
+// the state lane is full. A message longer than a slot is dropped and counted
+// rather than published cut off.
+void queueState(const char* topic, const JsonDocument& doc) {
+    if (measureJson(doc) >= PUBLISH_PAYLOAD_MAX) {
+        stateOversize++;
+        logPrintf("Transmitter: State for %s exceeds %u bytes, dropped", topic, (unsigned)PUBLISH_PAYLOAD_MAX - 1);
+        return;
+    }
+    if (client.connected() && outbox.empty()) {
+        OutboundMessage* m = scheduler.reserve(LANE_STATE, topic);
+        if (m) {
+            m->len = serializeJson(doc, m->payload, sizeof(m->payload));
+            scheduler.commit(LANE_STATE);
+            return;
         }
-    };
+    }
+    char payload[PUBLISH_PAYLOAD_MAX];
+    size_t len = serializeJson(doc, payload, sizeof(payload));
+    outbox.push(topic, payload, len, clockValid() ? (uint32_t)time(nullptr) : 0, millis());
+}
 
-    // Always publish Battery
-    publishEntity("sensor", "battery", "Battery", "voltage", "V", "{{ value_json.batteryVoltage | round(2) }}");
+// A state publish that failed goes back to the outbox instead of being lost.
+// Anything still behind it in the lane fails the same way and follows in order.
+void onStatePublishFailed(const OutboundMessage& m) {
+    outbox.push(m.topic, m.payload, m.len, clockValid() ? (uint32_t)time(nullptr) : 0, millis());
+}
 
-    if (sensorFlags & SENSOR_FLAG_BME) {
-        publishEntity("sensor", "temperature", "Temperature", "temperature", "°C", "{{ value_json.temperature | round(1) }}");
-        publishEntity("sensor", "humidity", "Humidity", "humidity", "%", "{{ value_json.humidity | round(1) }}");
-        publishEntity("sensor", "pressure", "Pressure", "pressure", "hPa", "{{ value_json.pressure | round(1) }}");
-    }
+// Moves the oldest outbox entry into the state lane, tagging it with its receive time
+void replayOutbox() {
+    static unsigned long lastReplay = 0;
+    if (outbox.empty() || !client.connected() || !scheduler.hasRoom(LANE_STATE)) return;
+    if (millis() - lastReplay < OUTBOX_REPLAY_INTERVAL_MS) return;
+    lastReplay = millis();
+
+    OutboxEntry e;
+    bool sameBoot;
+    if (!outbox.peek(e, sameBoot)) return;
 
-    if (sensorFlags & SENSOR_FLAG_LUX) {
-        publishEntity("sensor", "lux", "Illuminance", "illuminance", "lx", "{{ value_json.lux | round(1) }}");
+    uint32_t ts = e.rxEpoch;
+    if (ts == 0 && sameBoot && clockValid()) {
+        ts = time(nullptr) - (millis() - e.rxMillis) / 1000;
+    }
+    // Insert ,"ts":<epoch> before the closing brace if it fits (backlog samples lead with their own)
+    bool hasTs = e.len > 6 && memcmp(e.payload, "{\"ts\":", 6) == 0;
+    if (ts != 0 && !hasTs && e.len > 2 && e.payload[e.len - 1] == '}') {
+        char tsField[20];
+        int n = snprintf(tsField, sizeof(tsField), ",\"ts\":%u}", (unsigned)ts);
+        if (e.len - 1 + n <= PUBLISH_PAYLOAD_MAX) {
+            memcpy(e.payload + e.len - 1, tsField, n);
+            e.len += n - 1;
+        }
     }
+    scheduler.enqueue(LANE_STATE, e.topic, e.payload, e.len);
+    outbox.pop();
+}
+
+// Fills the DATA fields of a state message from a (v1 layout) reading
+void fillDataDoc(JsonDocument& doc, const DataMessage& data) {
+    doc["sensorFlags"] = data.sensorFlags;
+    doc["batteryVoltage"] = data.batteryVoltage;
 
-    if (sensorFlags & SENSOR_FLAG_SOIL) {
-        publishEntity("sensor", "soil", "Soil Moisture", "moisture", "%", "{{ value_json.soil | round(1) }}");
+    if (data.sensorFlags & SENSOR_FLAG_BME) {
+        doc["temperature"] = data.bme.temperature;
+        doc["humidity"] = data.bme.humidity;
+        doc["pressure"] = data.bme.pressure;
+    }
+    if (data.sensorFlags & SENSOR_FLAG_LUX) {
+        doc["lux"] = data.lux.lux;
     }
+    if (data.sensorFlags & SENSOR_FLAG_SOIL) {
+        doc["soil"] = data.soil.moisture;
+    }
+    if (data.sensorFlags & SENSOR_FLAG_BINARY) {
+        doc["binaryState"] = data.binary.state;
+    }
+}
 
-    if (sensorFlags & SENSOR_FLAG_BINARY) {
-        // Binary Sensor
-        // Note: component is "binary_sensor", stat_class is usually null for binary
-        DynamicJsonDocument doc(1024);
-        String entityKey = "binary";
-        String discoveryTopic = String("homeassistant/binary_sensor/") + slugify(deviceName) + "/" + entityKey + "/config";
-        
-        doc["name"] = "Binary Sensor";
-        doc["stat_t"] = String(mqtt_topic_base) + "/" + slugify(deviceName) + "/state";
-        doc["uniq_id"] = uniqueIdBase + "_" + entityKey;
-        doc["val_tpl"] = "{{ 'ON' if value_json.binaryState else 'OFF' }}";
-        doc["exp_aft"] = expireAfter;
-        // doc["dev_cla"] = "door"; // Optional, can let user customize in HA
-
-        JsonObject device = doc.createNestedObject("dev");
-        JsonArray identifiers = device.createNestedArray("ids");
-        if (macAddress && strlen(macAddress) > 0) identifiers.add(macAddress);
-        identifiers.add(deviceName);
-        device["name"] = deviceName;
-        device["mdl"] = "ESP-NOW Sensor";
-        device["mf"] = "Antigravity";
-
-        char buffer[1024];
-        serializeJson(doc, buffer);
-        if (client.publish(discoveryTopic.c_str(), buffer, true)) {
-            log("✓ Published discovery: " + discoveryTopic);
-        } else {
-            log("✗ Failed to publish discovery: " + discoveryTopic);
+// Expands a CONFIG packet forwarded by the Gateway into the JSON shape
+// consumed by handleGatewayMessage(). Returns false for short packets.
+bool expandConfig(const LinkRecord& rec, JsonDocument& doc) {
+    if (rec.packetLen < CONFIG_MESSAGE_V1_SIZE) return false;
+    char macStr[18];
+    formatMac(rec.mac, macStr);
+
+    ConfigMessage config;
+    memset(&config, 0, sizeof(config));
+    memcpy(&config, rec.packet, rec.packetLen < sizeof(config) ? rec.packetLen : sizeof(config));
+    config.deviceName[sizeof(config.deviceName) - 1] = '\0';
+    doc.clear();
+    doc["mac"] = macStr;
+    doc["type"] = "CONFIG";
+    doc["deviceName"] = config.deviceName;
+    doc["sensorFlags"] = config.sensorFlags;
+    doc["sleepInterval"] = config.sleepInterval;
+    doc["heartbeatInterval"] = config.heartbeatInterval; // 0 from v1 devices
+    return true;
+}
+
+// Publishes a live reading (v1 or v2 DATA) to the device's state topic.
+// Unknown and short packets are ignored.
+void publishData(const LinkRecord& rec, const DeviceTopics& dev) {
+    uint8_t type = rec.packet[0];
+    DataMessage data;
+    linkDoc.clear();
+    if (type == MSG_DATA && rec.packetLen >= sizeof(DataMessage)) {
+        memcpy(&data, rec.packet, sizeof(DataMessage));
+    } else if (type == MSG_DATA_V2) {
+        SensorSample sample;
+        uint16_t seq;
+        if (!decodeDataV2(rec.packet, rec.packetLen, sample, seq)) {
+            char macStr[18];
+            formatMac(rec.mac, macStr);
+            logPrintf("Transmitter: Malformed v2 DATA from %s", macStr);
+            return;
         }
+        sampleToDataMessage(sample, data);
+        linkDoc["seq"] = seq;
+    } else {
+        return;
+    }
+
+    logPrintf("Transmitter: Received DATA from Gateway for: %s", dev.name);
+    fillDataDoc(linkDoc, data);
+    queueState(dev.state, linkDoc);
+}
+
+// Publishes each sample of a Device backlog batch as a state message, oldest
+// first. Samples carry their capture time as "ts" when the clock is set, else
+// their "age" in seconds at receive time.
+void publishBatch(const LinkRecord& rec, const DeviceTopics& dev) {
+    BatchReader reader(rec.packet, rec.packetLen);
+    if (!reader.valid() || rec.nameLen == 0) return;
+
+    uint32_t now = clockValid() ? (uint32_t)time(nullptr) : 0;
+    uint8_t published = 0;
+    TimedSample ts;
+    while (reader.next(ts)) {
+        linkDoc.clear();
+        if (now) linkDoc["ts"] = now - ts.t; // Leads the payload, see replayOutbox()
+        else linkDoc["age"] = ts.t;
+        linkDoc["seq"] = ts.seq;
+        DataMessage data;
+        sampleToDataMessage(ts.s, data);
+        fillDataDoc(linkDoc, data);
+        queueState(dev.state, linkDoc);
+        published++;
     }
+    if (!reader.valid()) logPrintf("Transmitter: Malformed BATCH from %s", dev.name);
+    logPrintf("Transmitter: Backlog of %u samples from %s", (unsigned)published, dev.name);
+}
+
+// Topics of a device named in a JSON message: from the table, else built into `scratch`
+const DeviceTopics& topicsByName(const char* name, DeviceTopics& scratch) {
+    const DeviceTopics* dev = deviceTopics.findByName(name);
+    if (dev) return *dev;
+    static const uint8_t noMac[6] = {0};
+    deviceTopicsFill(scratch, mqtt_topic_base, noMac, name, strlen(name));
+    return scratch;
+}
+
+void handleGatewayMessage(JsonDocument& doc) {
+    const char* type = doc["type"];
+    const char* deviceName = doc["deviceName"];
+    logPrintf("Transmitter: Received %s from Gateway for: %s", type ? type : "null", deviceName ? deviceName : "null");
     
-    // Helper for Buttons
-    auto publishButton = [&](const char* slug, const char* name, const char* cmdPayload, const char* icon = "mdi:gesture-tap-button") {
-        DynamicJsonDocument doc(1024);
-        String discoveryTopic = String("homeassistant/button/") + slugify(deviceName) + "/" + slug + "/config";
-        
-        doc["name"] = name;
-        doc["cmd_t"] = String(mqtt_topic_base) + "/" + slugify(deviceName) + "/control";
-        doc["pl_prs"] = cmdPayload;
-        doc["uniq_id"] = uniqueIdBase + "_btn_" + slug;
-        doc["ic"] = icon;
-        doc["ret"] = false;
-
-        JsonObject device = doc.createNestedObject("dev");
-        JsonArray identifiers = device.createNestedArray("ids");
-        if (macAddress && strlen(macAddress) > 0) identifiers.add(macAddress);
-        identifiers.add(deviceName);
-        device["name"] = deviceName;
-        device["mdl"] = "ESP-NOW Sensor";
-        device["mf"] = "Antigravity";
-
-        char buffer[1024];
-        serializeJson(doc, buffer);
-        if (client.publish(discoveryTopic.c_str(), buffer, true)) {
-            log("✓ Published button: " + String(name));
+    if (doc["type"] == "CONFIG" && deviceName) {
+        publishDiscoveryWithMac(doc, doc["mac"] | "");
+    } else if (doc["type"] == "HEARTBEAT") {
+        // Update watchdog
+        lastGatewayHeartbeat = millis();
+        if (!gatewayOnline) {
+            log("Gateway is ONLINE (Heartbeat)");
+            gatewayOnline = true;
+            // Publish online status
+            scheduler.enqueue(LANE_AVAILABILITY, "espnow/gateway/state", "{\"status\":\"online\"}", true);
+        }
+        // The rest of the heartbeat is Gateway counters (receive ring, callback timing, mailbox)
+        doc.remove("type");
+        doc.remove("device");
+        char payload[PUBLISH_PAYLOAD_MAX];
+        size_t len = serializeJson(doc, payload, sizeof(payload));
+        scheduler.enqueue(LANE_AVAILABILITY, "espnow/gateway/stats", payload, len);
+    } else if (doc["type"] == "CMD_STATUS" && deviceName) {
+        // Fate of a queued device command, reported by the Gateway mailbox
+        DeviceTopics scratch;
+        const DeviceTopics& topics = topicsByName(deviceName, scratch);
+        doc.remove("deviceName");
+        doc.remove("type");
+        char payload[PUBLISH_PAYLOAD_MAX];
+        size_t len = serializeJson(doc, payload, sizeof(payload));
+        scheduler.enqueue(LANE_AVAILABILITY, topics.status, payload, len);
+    } else if (deviceName) {
+        // ... existing state/control handling ...
+        DeviceTopics scratch;
+        const DeviceTopics& topics = topicsByName(deviceName, scratch);
+        doc.remove("deviceName");
+        doc.remove("type");
+        doc.remove("mac");
+        queueState(topics.state, doc);
+    } else if (doc["device"] == "gateway") {
+         doc.remove("device"); // Strip routing field
+         char payload[PUBLISH_PAYLOAD_MAX];
+         size_t len = serializeJson(doc, payload, sizeof(payload));
+         scheduler.enqueue(LANE_AVAILABILITY, "espnow/gateway/state", payload, len, true); // Retain gateway status
+         
+         // Treat any gateway message as a heartbeat
+         lastGatewayHeartbeat = millis();
+         if (!gatewayOnline) gatewayOnline = true; 
+    }
+}
+
+// Publishes a device wake-cycle profile to espnow/<slug>/diag as {"wakes":N,"<phase>":[min,avg,max],...} in ms.
+// Published directly like publishStats(): diagnostics only, larger than a lane slot, not worth an outbox entry.
+void publishProfile(const LinkRecord& rec, const DeviceTopics& dev) {
+    ProfileMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    memcpy(&msg, rec.packet, rec.packetLen < sizeof(msg) ? rec.packetLen : sizeof(msg));
+    size_t available = rec.packetLen < offsetof(ProfileMessage, phases) ? 0 :
+                       (rec.packetLen - offsetof(ProfileMessage, phases)) / sizeof(PhaseSummary);
+    uint8_t count = msg.phaseCount;
+    if (count > PHASE_COUNT) count = PHASE_COUNT;
+    if (count > available) count = available;
+    if (rec.nameLen == 0 || count == 0) return;
+
+    char topic[PUBLISH_TOPIC_MAX];
+    snprintf(topic, sizeof(topic), "%.*sdiag", dev.prefixLen, dev.state);
+
+    char payload[512];
+    size_t n = snprintf(payload, sizeof(payload), "{\"wakes\":%u", msg.wakes);
+    for (uint8_t i = 0; i < count && n < sizeof(payload); i++) {
+        const PhaseSummary& p = msg.phases[i];
+        n += snprintf(payload + n, sizeof(payload) - n, ",\"%s\":[%.1f,%.1f,%.1f]", PROFILE_PHASE_KEYS[i],
+                      p.minTicks * PROFILE_TICK_US / 1000.0, p.avgTicks * PROFILE_TICK_US / 1000.0,
+                      p.maxTicks * PROFILE_TICK_US / 1000.0);
+    }
+    if (n + 1 >= sizeof(payload)) return;
+    payload[n++] = '}';
+    payload[n] = '\0';
+
+    logPrintf("Transmitter: Profile from %s (%u wakes)", dev.name, (unsigned)msg.wakes);
+    if (client.connected()) client.publish(topic, payload);
+}
+
+// Looks up the sender of a record and fills in its MAC and name. Returns
+// nullptr for an id that has not been announced.
+const DeviceTopics* resolveRecord(LinkRecord& rec) {
+    if (rec.id == 0) return &unknownDevice; // rec.mac is in the record, no name
+    const DeviceTopics* dev = deviceTopics.get(rec.id);
+    if (!dev) return nullptr;
+    rec.mac = dev->mac;
+    rec.name = dev->name;
+    rec.nameLen = dev->nameLen;
+    return dev;
+}
+
+// `payload` points into the link parser's buffer and is consumed in place.
+// Returns false, having done nothing, for a record whose device id is unknown.
+bool handleLinkFrame(uint8_t frameType, uint8_t* payload, size_t len) {
+    if (frameType == LINK_FRAME_RECORD) {
+        LinkRecord rec;
+        if (!linkParseRecord(payload, len, rec)) return true;
+        const DeviceTopics* dev = resolveRecord(rec);
+        if (!dev) return false;
+        if (rec.packet[0] == MSG_PROFILE) {
+            publishProfile(rec, *dev);
+        } else if (rec.packet[0] == MSG_BATCH) {
+            publishBatch(rec, *dev);
+        } else if (rec.packet[0] == MSG_CONFIG) {
+            if (expandConfig(rec, linkDoc)) handleGatewayMessage(linkDoc);
+        } else {
+            publishData(rec, *dev);
+        }
+    } else if (frameType == LINK_FRAME_DEVICE) {
+        LinkDevice d;
+        if (linkParseDevice(payload, len, d) && deviceTopics.set(d.id, d.mac, d.name, d.nameLen)) {
+            logPrintf("Transmitter: Device %u is %s", d.id, deviceTopics.get(d.id)->name);
+        }
+    } else if (frameType == LINK_FRAME_JSON) {
+        // Zero-copy: a writable input lets strings in linkDoc point into the frame
+        DeserializationError error = deserializeJson(linkDoc, (char*)payload, len);
+        if (!error) {
+            handleGatewayMessage(linkDoc);
         } else {
-            log("✗ Failed to publish button: " + String(name));
+            logPrintf("Transmitter: JSON Error: %s", error.c_str());
         }
-    };
+    }
+    return true;
+}
 
-    // Standard Buttons
-    publishButton("restart", "Restart Device", "{\"cmd\": \"restart\"}", "mdi:restart");
-    publishButton("ota", "Wake Up / OTA", "{\"cmd\": \"ota\"}", "mdi:cloud-upload");
+// Receive side of the link flow control (see serial_link.h)
+bool linkSynced = false;      // False until the first SYNC after boot
+uint16_t linkExpected = 0;    // Next sequence number to process
+uint8_t linkSinceGrant = 0;
+unsigned long linkLastGrant = 0;
+bool linkGapReported = false;
+uint32_t linkDuplicates = 0;
+uint32_t linkGaps = 0;
+
+// Grants the Gateway LINK_WINDOW frames past the last one processed. Before
+// the first SYNC there is nothing to acknowledge, which asks for one (and for
+// all device ids).
+void sendLinkCredit(bool resend, bool announce = false) {
+    char line[96];
+    if (linkSynced) {
+        snprintf(line, sizeof(line), "{\"link\":\"credit\",\"ack\":%u,\"win\":%u%s%s}",
+                 (uint16_t)(linkExpected - 1), LINK_WINDOW, resend ? ",\"resend\":true" : "",
+                 announce ? ",\"announce\":true" : "");
+    } else {
+        snprintf(line, sizeof(line), "{\"link\":\"credit\",\"win\":%u}", LINK_WINDOW);
+    }
+    linkSerial.println(line);
+    linkSinceGrant = 0;
+    linkLastGrant = millis();
+}
 
-    if (sensorFlags & SENSOR_FLAG_SOIL) {
-        publishButton("calibrate", "Calibrate Soil Sensor", "{\"cmd\": \"calibrate\"}", "mdi:water-percent");
+void pollGatewayLink() {
+    while (linkSerial.available()) {
+        if (!linkParser.push(linkSerial.read())) continue;
+        uint16_t seq = linkParser.seq();
+        if (linkParser.type() == LINK_FRAME_SYNC) {
+            linkSynced = true;
+            linkExpected = seq;
+            linkGapReported = false;
+            sendLinkCredit(false);
+            continue;
+        }
+        if (!linkSynced) {
+            // Restarted: these are retransmissions that may start mid-burst. The
+            // ack-less credits sent until now make the Gateway restart with a SYNC.
+            continue;
+        }
+        int16_t ahead = (int16_t)(seq - linkExpected);
+        if (ahead < 0) {
+            linkDuplicates++; // Retransmission of a frame we already have
+            continue;
+        }
+        if (ahead > 0) {
+            // A frame was lost (CRC error, overflow): ask once for the rest again
+            linkGaps++;
+            if (!linkGapReported) sendLinkCredit(true);
+            linkGapReported = true;
+            continue;
+        }
+        if (!handleLinkFrame(linkParser.type(), linkParser.payload(), linkParser.length())) {
+            // Unknown device id: leave the record unacknowledged and have the Gateway
+            // announce its devices ahead of it. The rest of the burst is dropped as a gap.
+            linkUnknownIds++;
+            sendLinkCredit(false, true);
+            linkGapReported = true;
+            continue;
+        }
+        linkExpected++;
+        linkGapReported = false;
+        if (++linkSinceGrant >= LINK_WINDOW / 2) sendLinkCredit(false);
     }
-    
-    discoveredDevices[slugName] = true;
+    if (linkOverflowed()) serialOverflows++;
+    if (millis() - linkLastGrant >= LINK_CREDIT_INTERVAL_MS) sendLinkCredit(false);
+}
+
+// Scheduler/link/outbox counters, e.g. to confirm no serial bytes are lost during discovery bursts.
+// Published directly (not queued): it is diagnostics only and larger than a lane slot.
+void publishStats() {
+    if (!client.connected()) return;
+    const PublishStats& st = scheduler.stats();
+    char payload[512];
+    snprintf(payload, sizeof(payload),
+             "{\"stateDepth\":%u,\"stateHighWater\":%u,\"discoveryDepth\":%u,\"discoveryHighWater\":%u,"
+             "\"dropped\":%u,\"oversize\":%u,\"deferred\":%u,\"maxServiceUs\":%u,\"serialOverflows\":%u,\"linkCrcErrors\":%u,"
+             "\"linkDuplicates\":%u,\"linkGaps\":%u,\"linkUnknownIds\":%u,"
+             "\"outboxRam\":%u,\"outboxFileBytes\":%u,\"spilled\":%u,\"replayed\":%u,\"outboxDropped\":%u}",
+             st.depth[LANE_STATE], st.highWater[LANE_STATE], st.depth[LANE_DISCOVERY], st.highWater[LANE_DISCOVERY],
+             (unsigned)(st.dropped[LANE_STATE] + st.dropped[LANE_AVAILABILITY] + st.dropped[LANE_DISCOVERY]),
+             (unsigned)stateOversize, (unsigned)st.deferred, (unsigned)st.maxServiceUs, (unsigned)serialOverflows, (unsigned)linkParser.crcErrors,
+             (unsigned)linkDuplicates, (unsigned)linkGaps, (unsigned)linkUnknownIds,
+             outbox.ramDepth(), (unsigned)outbox.fileBytes(), (unsigned)outbox.stats().spilled,
+             (unsigned)outbox.stats().replayed, (unsigned)outbox.stats().dropped);
+    client.publish("espnow/transmitter/stats", payload);
 }
 
 void setup() {
-    Serial.begin(115200);
-    swSerial.begin(9600);
+    linkBegin();
     if(!LittleFS.begin()){
-        Serial.println("LittleFS mount failed");
+        LOG_SERIAL.println("LittleFS mount failed");
     }
     loadConfig();
+    discoveryCache.load();
+    outbox.begin();
+    static const uint8_t noMac[6] = {0};
+    deviceTopicsFill(unknownDevice, mqtt_topic_base, noMac, "unknown", 7);
 
     WiFiManager wm;
+    wm.setDebugOutput(false); // Serial is the Gateway link with LINK_HW_UART
     wm.setSaveConfigCallback(saveConfigCallback);
     // Use smaller timeout for auto-connect at boot
     wm.setConnectTimeout(20); 
@@ -292,9 +637,12 @@ void setup() {
         startMqttConfigPortal(mqtt_cfg, "ESPNOW-Transmitter");
     }
 
+    configTime(0, 0, "pool.ntp.org"); // Wall clock for outbox replay timestamps
     client.setServer(mqtt_cfg.server, mqtt_cfg.port);
     client.setCallback(mqtt_callback);
     client.setBufferSize(2048); 
+    scheduler.onDiscoveryDone(onDiscoveryPublished);
+    scheduler.onStateFailed(onStatePublishFailed);
 
     ArduinoOTA.onStart([]() { isOTAUpdating = true; log("OTA Starting..."); });
     ArduinoOTA.onEnd([]() { isOTAUpdating = false; log("OTA Complete!"); });
@@ -305,11 +653,9 @@ void setup() {
 
 void loop() {
 
-    static unsigned long lastGatewayHeartbeat = 0;
-    static bool gatewayOnline = false;
-    
     ArduinoOTA.handle();
     if (isOTAUpdating) return;
+    if (configPortal.process()) log("Config Portal closed");
     if (!client.connected()) reconnect();
     client.loop();
 
@@ -322,59 +668,27 @@ void loop() {
         } else nC.stop();
     }
 
-    while (swSerial.available()) {
-        char c = swSerial.read();
-        static String inputBuffer = "";
-        if (c == '\n') {
-            if (inputBuffer.length() > 0) {
-                DynamicJsonDocument doc(1280); // Slightly larger
-                DeserializationError error = deserializeJson(doc, inputBuffer);
-                if (!error) {
-                    const char* type = doc["type"];
-                    const char* deviceName = doc["deviceName"];
-                    log("Transmitter: Received " + String(type ? type : "null") + " from Gateway for: " + String(deviceName ? deviceName : "null"));
-                    
-                    if (doc["type"] == "CONFIG" && deviceName) {
-                        publishDiscoveryWithMac(doc, doc["mac"] | "");
-                    } else if (doc["type"] == "HEARTBEAT") {
-                        // Update watchdog
-                        lastGatewayHeartbeat = millis();
-                        if (!gatewayOnline) {
-                            log("Gateway is ONLINE (Heartbeat)");
-                            gatewayOnline = true;
-                            // Publish online status
-                            if (client.connected()) {
-                                client.publish("espnow/gateway/state", "{\"status\":\"online\"}", true);
-                            }
-                        }
-                    } else if (deviceName) {
-                        // ... existing state/control handling ...
-                        String topic = String(mqtt_topic_base) + "/" + slugify(deviceName) + "/state";
-                        doc.remove("deviceName");
-                        doc.remove("type");
-                        doc.remove("mac");
-                        String payload; serializeJson(doc, payload);
-                        client.publish(topic.c_str(), payload.c_str());
-                    } else if (doc["device"] == "gateway") {
-                         doc.remove("device"); // Strip routing field
-                         String payload; serializeJson(doc, payload);
-                         client.publish("espnow/gateway/state", payload.c_str(), true); // Retain gateway status
-                         
-                         // Treat any gateway message as a heartbeat
-                         lastGatewayHeartbeat = millis();
-                         if (!gatewayOnline) gatewayOnline = true; 
-                    }
-                } else {
-                    log("Transmitter: JSON Error: " + String(error.c_str()) + " in buffer: " + inputBuffer);
-                }
-                inputBuffer = "";
-            }
-        } else if (c != '\r') inputBuffer += c;
+    pollGatewayLink();
+
+    // Republish cached discovery after a HA birth message, as fast as the lane drains
+    while (discoveryReplayNext < discoveryCache.size() && scheduler.hasRoom(LANE_DISCOVERY)) {
+        uint8_t i = discoveryReplayNext++;
+        scheduler.enqueueDiscovery(discoveryCache.toDevice(i), discoveryCache.needsMigration(discoveryCache.at(i).slug));
+    }
+
+    replayOutbox();
+    scheduler.service(PUBLISH_BUDGET_US);
+    discoveryCache.flush(); // One write for everything discovery stored during this pass
+    pollGatewayLink();
+
+    static unsigned long lastStats = 0;
+    if (millis() - lastStats > 60000) {
+        lastStats = millis();
+        publishStats();
     }
 
     // --- Gateway Watchdog ---
     // Monitor heartbeat from Gateway
-    // Variables moved to top of loop()
 
     // Check if we received a heartbeat recently (timeout: 70s > 2 missed heartbeats)
     if (millis() - lastGatewayHeartbeat > 70000) {
@@ -382,9 +696,7 @@ void loop() {
             log("Gateway is OFFLINE (Watchdog)");
             gatewayOnline = false;
             // Publish offline status
-             if (client.connected()) {
-                client.publish("espnow/gateway/state", "{\"status\":\"offline\"}", true);
-             }
+            scheduler.enqueue(LANE_AVAILABILITY, "espnow/gateway/state", "{\"status\":\"offline\"}", true);
         }
     }
 }
@@ -0,0 +1,151 @@
+#include "outbox.h"
+#include <LittleFS.h>
+
+// Segment record: [uint16 recordLen][uint32 rxEpoch][uint32 rxMillis][uint8 topicLen][topic][payload]
+static const size_t RECORD_HEADER = 2 + 4 + 4 + 1;
+
+static bool recordValid(uint16_t recordLen, uint8_t topicLen) {
+    return topicLen < PUBLISH_TOPIC_MAX &&
+           recordLen >= RECORD_HEADER - 2 + topicLen &&
+           recordLen - (RECORD_HEADER - 2) - topicLen <= PUBLISH_PAYLOAD_MAX;
+}
+
+void Outbox::begin() {
+    File f = LittleFS.open(OUTBOX_FILE, "r+");
+    if (!f) return;
+    uint32_t size = f.size();
+
+    // Walk the record headers up to the last complete record. A power loss
+    // mid-append leaves a partial tail; it is cut off here so new appends
+    // start on a record boundary instead of behind garbage.
+    uint32_t end = 0;
+    while (end + RECORD_HEADER <= size) {
+        uint16_t recordLen = 0;
+        uint8_t topicLen = 0;
+        if (!f.seek(end) || f.read((uint8_t*)&recordLen, 2) != 2 ||
+            !f.seek(end + RECORD_HEADER - 1) || f.read(&topicLen, 1) != 1 ||
+            !recordValid(recordLen, topicLen) || end + 2 + recordLen > size) {
+            break;
+        }
+        end += 2 + recordLen;
+    }
+    if (end < size) {
+        _stats.dropped++;
+        if (!f.truncate(end)) end = 0; // Cannot repair: start over
+    }
+    f.close();
+
+    _fileSize = end;
+    _readPos = 0;
+    _staleBefore = _fileSize;
+    _fileActive = _fileSize > 0;
+    if (!_fileActive) LittleFS.remove(OUTBOX_FILE);
+}
+
+bool Outbox::push(const char* topic, const char* payload, size_t len, uint32_t rxEpoch, uint32_t rxMillis) {
+    if (len > PUBLISH_PAYLOAD_MAX) {
+        _stats.dropped++;
+        return false;
+    }
+
+    OutboxEntry e;
+    e.rxEpoch = rxEpoch;
+    e.rxMillis = rxMillis;
+    strlcpy(e.topic, topic, sizeof(e.topic));
+    memcpy(e.payload, payload, len);
+    e.len = len;
+
+    // RAM only while nothing is waiting in the file, so RAM entries are always the oldest
+    if (!_fileActive && _ramCount < OUTBOX_RAM_SLOTS) {
+        _ram[(_ramHead + _ramCount) % OUTBOX_RAM_SLOTS] = e;
+        _ramCount++;
+        return true;
+    }
+
+    if (appendToFile(e)) {
+        _stats.spilled++;
+        return true;
+    }
+    _stats.dropped++;
+    return false;
+}
+
+bool Outbox::appendToFile(const OutboxEntry& e) {
+    uint8_t topicLen = strlen(e.topic);
+    uint16_t recordLen = RECORD_HEADER - 2 + topicLen + e.len;
+    if (_fileSize + 2 + recordLen > OUTBOX_MAX_FILE_BYTES) return false;
+
+    File f = LittleFS.open(OUTBOX_FILE, "a");
+    if (!f) return false;
+    size_t n = 0;
+    n += f.write((const uint8_t*)&recordLen, 2);
+    n += f.write((const uint8_t*)&e.rxEpoch, 4);
+    n += f.write((const uint8_t*)&e.rxMillis, 4);
+    n += f.write(&topicLen, 1);
+    n += f.write((const uint8_t*)e.topic, topicLen);
+    n += f.write((const uint8_t*)e.payload, e.len);
+    f.close();
+    if (n != 2u + recordLen) return false;
+
+    _fileSize += n;
+    _fileActive = true;
+    return true;
+}
+
+bool Outbox::readFileEntry(OutboxEntry& out, uint32_t& nextPos) {
+    File f = LittleFS.open(OUTBOX_FILE, "r");
+    if (!f || !f.seek(_readPos)) return false;
+    uint16_t recordLen = 0;
+    uint8_t topicLen = 0;
+    bool ok = f.read((uint8_t*)&recordLen, 2) == 2 &&
+              f.read((uint8_t*)&out.rxEpoch, 4) == 4 &&
+              f.read((uint8_t*)&out.rxMillis, 4) == 4 &&
+              f.read(&topicLen, 1) == 1 &&
+              recordValid(recordLen, topicLen);
+    if (ok) {
+        out.len = recordLen - (RECORD_HEADER - 2) - topicLen;
+        ok = f.read((uint8_t*)out.topic, topicLen) == topicLen &&
+             f.read((uint8_t*)out.payload, out.len) == out.len;
+        out.topic[topicLen] = '\0';
+    }
+    f.close();
+    nextPos = _readPos + 2 + recordLen;
+    return ok;
+}
+
+bool Outbox::peek(OutboxEntry& out, bool& sameBoot) {
+    if (_ramCount > 0) {
+        out = _ram[_ramHead];
+        sameBoot = true;
+        return true;
+    }
+    while (_fileActive) {
+        if (readFileEntry(out, _peekNext)) {
+            sameBoot = _readPos >= _staleBefore;
+            return true;
+        }
+        // Unreadable despite begin()'s check (flash error): discard the segment
+        _stats.dropped++;
+        _fileActive = false;
+        _fileSize = _readPos = _staleBefore = 0;
+        LittleFS.remove(OUTBOX_FILE);
+    }
+    return false;
+}
+
+void Outbox::pop() {
+    if (_ramCount > 0) {
+        _ramHead = (_ramHead + 1) % OUTBOX_RAM_SLOTS;
+        _ramCount--;
+        _stats.replayed++;
+        return;
+    }
+    if (!_fileActive) return;
+    _readPos = _peekNext;
+    _stats.replayed++;
+    if (_readPos >= _fileSize) {
+        _fileActive = false;
+        _fileSize = _readPos = _staleBefore = 0;
+        LittleFS.remove(OUTBOX_FILE);
+    }
+}
@@ -0,0 +1,170 @@
+#include "publish_scheduler.h"
+
+void PublishScheduler::noteDepth(PublishLane lane, uint8_t depth) {
+    _stats.depth[lane] = depth;
+    if (depth > _stats.highWater[lane]) _stats.highWater[lane] = depth;
+}
+
+template <uint8_t N>
+OutboundMessage* PublishScheduler::freeSlot(MessageLane<N>& q, const char* topic, bool retain) {
+    if (q.count >= N || strlen(topic) >= PUBLISH_TOPIC_MAX) return nullptr;
+    OutboundMessage& m = q.items[(q.head + q.count) % N];
+    strlcpy(m.topic, topic, sizeof(m.topic));
+    m.len = 0;
+    m.retain = retain;
+    return &m;
+}
+
+template <uint8_t N>
+void PublishScheduler::append(MessageLane<N>& q, PublishLane lane) {
+    q.count++;
+    noteDepth(lane, q.count);
+}
+
+template <uint8_t N>
+bool PublishScheduler::push(MessageLane<N>& q, PublishLane lane, const char* topic,
+                            const char* payload, size_t len, bool retain) {
+    OutboundMessage* m = len <= PUBLISH_PAYLOAD_MAX ? freeSlot(q, topic, retain) : nullptr;
+    if (!m) {
+        _stats.dropped[lane]++;
+        return false;
+    }
+    memcpy(m->payload, payload, len);
+    m->len = len;
+    append(q, lane);
+    return true;
+}
+
+template <uint8_t N>
+bool PublishScheduler::publishFront(MessageLane<N>& q, PublishLane lane) {
+    if (q.count == 0) return false;
+    OutboundMessage& m = q.items[q.head];
+    // Streamed from the slot rather than copied into PubSubClient's buffer first
+    bool ok = _client.beginPublish(m.topic, m.len, m.retain) &&
+              _client.write((const uint8_t*)m.payload, m.len) == m.len &&
+              _client.endPublish();
+    if (ok) _stats.published++;
+    else {
+        _stats.failed++;
+        if (lane == LANE_STATE && _stateFailed) _stateFailed(m);
+    }
+    q.head = (q.head + 1) % N;
+    q.count--;
+    noteDepth(lane, q.count);
+    return true;
+}
+
+bool PublishScheduler::enqueue(PublishLane lane, const char* topic, const char* payload, size_t len, bool retain) {
+    if (lane == LANE_STATE) return push(_state, lane, topic, payload, len, retain);
+    if (lane == LANE_AVAILABILITY) return push(_availability, lane, topic, payload, len, retain);
+    return false;
+}
+
+OutboundMessage* PublishScheduler::reserve(PublishLane lane, const char* topic, bool retain) {
+    if (lane == LANE_STATE) return freeSlot(_state, topic, retain);
+    if (lane == LANE_AVAILABILITY) return freeSlot(_availability, topic, retain);
+    return nullptr;
+}
+
+void PublishScheduler::commit(PublishLane lane) {
+    if (lane == LANE_STATE) append(_state, lane);
+    else if (lane == LANE_AVAILABILITY) append(_availability, lane);
+}
+
+bool PublishScheduler::hasRoom(PublishLane lane) const {
+    if (lane == LANE_STATE) return _state.count < STATE_LANE_SIZE;
+    if (lane == LANE_AVAILABILITY) return _availability.count < AVAILABILITY_LANE_SIZE;
+    return _discoveryCount < DISCOVERY_LANE_SIZE;
+}
+
+bool PublishScheduler::enqueueDiscovery(const DiscoveryDevice& dev, bool clearOther) {
+    DiscoveryJob* job = nullptr;
+    for (uint8_t i = 0; i < _discoveryCount; i++) {
+        DiscoveryJob& j = _discovery[(_discoveryHead + i) % DISCOVERY_LANE_SIZE];
+        if (strcmp(j.dev.slug, dev.slug) == 0) { job = &j; break; }
+    }
+    if (job && !job->cleared) clearOther = true; // Still owed by the job being replaced
+    if (!job) {
+        if (_discoveryCount >= DISCOVERY_LANE_SIZE) {
+            _stats.dropped[LANE_DISCOVERY]++;
+            return false;
+        }
+        job = &_discovery[(_discoveryHead + _discoveryCount) % DISCOVERY_LANE_SIZE];
+        _discoveryCount++;
+        noteDepth(LANE_DISCOVERY, _discoveryCount);
+    }
+    strlcpy(job->dev.name, dev.name, sizeof(job->dev.name));
+    strlcpy(job->dev.slug, dev.slug, sizeof(job->dev.slug));
+    strlcpy(job->dev.mac, dev.mac, sizeof(job->dev.mac));
+    job->dev.sensorFlags = dev.sensorFlags;
+    job->dev.expireAfter = dev.expireAfter;
+    job->nextEntity = 0;
+    job->cleared = !clearOther;
+    job->failed = false;
+    return true;
+}
+
+bool PublishScheduler::stepDiscovery() {
+    if (_discoveryCount == 0) return false;
+    DiscoveryJob& job = _discovery[_discoveryHead];
+    DiscoveryDevice dev;
+    dev.name = job.dev.name;
+    dev.slug = job.dev.slug;
+    dev.mac = job.dev.mac;
+    dev.sensorFlags = job.dev.sensorFlags;
+    dev.expireAfter = job.dev.expireAfter;
+
+    bool done;
+#ifdef HA_DEVICE_DISCOVERY
+    // Migrating: clear every per-entity config first, fitted or not, since the
+    // broker may hold them from before the switch or from an older sensorFlags
+    if (!job.cleared) {
+        if (clearEntityDiscovery(_client, dev, DISCOVERY_ENTITIES[job.nextEntity])) _stats.published++;
+        else { _stats.failed++; job.failed = true; }
+        job.cleared = ++job.nextEntity >= DISCOVERY_ENTITY_COUNT;
+        return true;
+    }
+    if (publishDeviceDiscovery(_client, dev)) _stats.published++;
+    else { _stats.failed++; job.failed = true; }
+    done = true;
+#else
+    if (!job.cleared) {
+        if (clearDeviceDiscovery(_client, dev)) _stats.published++;
+        else { _stats.failed++; job.failed = true; }
+        job.cleared = true;
+        return true;
+    }
+    while (job.nextEntity < DISCOVERY_ENTITY_COUNT &&
+           !entityEnabled(DISCOVERY_ENTITIES[job.nextEntity], dev.sensorFlags)) {
+        job.nextEntity++;
+    }
+    if (job.nextEntity < DISCOVERY_ENTITY_COUNT) {
+        if (publishEntityDiscovery(_client, dev, DISCOVERY_ENTITIES[job.nextEntity])) _stats.published++;
+        else { _stats.failed++; job.failed = true; }
+        job.nextEntity++;
+    }
+    done = job.nextEntity >= DISCOVERY_ENTITY_COUNT;
+#endif
+
+    if (done) {
+        if (_discoveryDone) _discoveryDone(dev, !job.failed);
+        _discoveryHead = (_discoveryHead + 1) % DISCOVERY_LANE_SIZE;
+        _discoveryCount--;
+        noteDepth(LANE_DISCOVERY, _discoveryCount);
+    }
+    return true;
+}
+
+void PublishScheduler::service(uint32_t budgetUs) {
+    if (!_client.connected()) return;
+    uint32_t start = micros();
+    while (micros() - start < budgetUs) {
+        if (publishFront(_state, LANE_STATE)) continue;
+        if (publishFront(_availability, LANE_AVAILABILITY)) continue;
+        if (stepDiscovery()) continue;
+        break; // Nothing left
+    }
+    uint32_t elapsed = micros() - start;
+    if (elapsed > _stats.maxServiceUs) _stats.maxServiceUs = elapsed;
+    if (!idle()) _stats.deferred++;
+}
@@ -0,0 +1,38 @@
+#ifndef ARDUINO_STUB_H
+#define ARDUINO_STUB_H
+
+// Host stand-in for the few Arduino functions the Transmitter modules under
+// test use. Only built by the native env.
+
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+inline char* itoa(int value, char* out, int /*base*/) {
+    sprintf(out, "%d", value);
+    return out;
+}
+
+// Not every host libc has strlcpy
+inline size_t stubStrlcpy(char* dst, const char* src, size_t cap) {
+    size_t len = strlen(src);
+    if (cap > 0) {
+        size_t n = len < cap - 1 ? len : cap - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#define strlcpy stubStrlcpy
+
+inline uint32_t micros() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline uint32_t millis() { return micros() / 1000; }
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef PUBSUBCLIENT_STUB_H
+#define PUBSUBCLIENT_STUB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Host stand-in for PubSubClient that keeps the last message in fixed
+// buffers, so it allocates nothing itself. Only built by the native env.
+
+#define PUBSUB_STUB_PAYLOAD_MAX 4096
+
+class PubSubClient {
+public:
+    bool connected() { return online; }
+
+    bool publish(const char* topic, const uint8_t* payload, unsigned int len, bool retained) {
+        return beginPublish(topic, len, retained) && write(payload, len) == len && endPublish();
+    }
+
+    bool publish(const char* topic, const char* payload, bool retained) {
+        return publish(topic, (const uint8_t*)payload, strlen(payload), retained);
+    }
+
+    bool beginPublish(const char* topic, unsigned int len, bool retained) {
+        if (!online || failPublish) return false;
+        size_t n = strnlen(topic, sizeof(lastTopic) - 1);
+        memcpy(lastTopic, topic, n);
+        lastTopic[n] = '\0';
+        announced = len;
+        written = 0;
+        lastRetained = retained;
+        return true;
+    }
+
+    size_t write(const uint8_t* data, size_t len) {
+        if (written + len > sizeof(lastPayload) - 1) return 0;
+        memcpy(lastPayload + written, data, len);
+        written += len;
+        return len;
+    }
+
+    // Like the real client, a message whose length differs from beginPublish() fails
+    int endPublish() {
+        lastPayload[written] = '\0';
+        publishes++;
+        bytes += written;
+        return written == announced;
+    }
+
+    bool online = true;
+    bool failPublish = false; // Connected, but publishes fail (broker dropping mid-publish)
+    char lastTopic[128] = {};
+    char lastPayload[PUBSUB_STUB_PAYLOAD_MAX] = {};
+    bool lastRetained = false;
+    size_t announced = 0;
+    size_t written = 0;
+    uint32_t publishes = 0;
+    uint32_t bytes = 0;
+};
+
+#endif
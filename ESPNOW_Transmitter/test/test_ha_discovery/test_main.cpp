@@ -0,0 +1,183 @@
+#include <unity.h>
+#include <chrono>
+#include <new>
+#include "ha_discovery.h"
+#include "publish_scheduler.h"
+
+// Discovery payload tests and a per-device benchmark (heap bytes and time)
+// for the streaming publisher: pio test -e native
+
+const char* mqtt_topic_base = "espnow";
+
+// Counts every operator new while `counting` is set
+static bool counting = false;
+static uint32_t allocations = 0;
+static size_t allocatedBytes = 0;
+
+void* operator new(size_t n) {
+    if (counting) { allocations++; allocatedBytes += n; }
+    void* p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static PubSubClient client;
+
+void setUp() { client = PubSubClient(); }
+void tearDown() {}
+
+static const DiscoveryDevice climate = {"Living Room", "living_room", "C4:5B:BE:61:86:09",
+                                        SENSOR_FLAG_BME | SENSOR_FLAG_LUX, 900};
+
+static bool contains(const char* text, const char* part) { return strstr(text, part) != nullptr; }
+
+void test_entity_payload() {
+    const EntityDesc* temperature = nullptr;
+    for (const EntityDesc& e : DISCOVERY_ENTITIES) if (strcmp(e.key, "temperature") == 0) temperature = &e;
+    TEST_ASSERT_NOT_NULL(temperature);
+
+    TEST_ASSERT_TRUE(publishEntityDiscovery(client, climate, *temperature));
+    TEST_ASSERT_EQUAL_STRING("homeassistant/sensor/living_room/temperature/config", client.lastTopic);
+    TEST_ASSERT_TRUE(client.lastRetained);
+    TEST_ASSERT_EQUAL(client.announced, client.written);
+    TEST_ASSERT_TRUE(contains(client.lastPayload, "\"stat_t\":\"espnow/living_room/state\""));
+    TEST_ASSERT_TRUE(contains(client.lastPayload, "\"uniq_id\":\"C45BBE618609_temperature\""));
+    TEST_ASSERT_TRUE(contains(client.lastPayload, "\"exp_aft\":900"));
+    TEST_ASSERT_TRUE(contains(client.lastPayload, "\"ids\":[\"C4:5B:BE:61:86:09\",\"Living Room\"]"));
+}
+
+void test_device_payload() {
+    TEST_ASSERT_TRUE(publishDeviceDiscovery(client, climate));
+    TEST_ASSERT_EQUAL_STRING("homeassistant/device/living_room/config", client.lastTopic);
+    TEST_ASSERT_EQUAL(client.announced, client.written);
+    TEST_ASSERT_TRUE(contains(client.lastPayload, "\"cmps\":{"));
+    TEST_ASSERT_TRUE(contains(client.lastPayload, "\"lux\":{\"p\":\"sensor\""));
+    TEST_ASSERT_TRUE(contains(client.lastPayload, "\"restart\":{\"p\":\"button\""));
+    TEST_ASSERT_FALSE(contains(client.lastPayload, "\"soil\"")); // Not fitted
+    TEST_ASSERT_FALSE(contains(client.lastPayload, "\"calibrate\""));
+
+    int depth = 0;
+    for (const char* p = client.lastPayload; *p; p++) {
+        if (*p == '{') depth++;
+        if (*p == '}') depth--;
+        TEST_ASSERT_TRUE(depth >= 0);
+    }
+    TEST_ASSERT_EQUAL(0, depth);
+}
+
+void test_escapes_name_without_mac() {
+    const DiscoveryDevice odd = {"Shed \"North\"", "shed_\"north\"", "", SENSOR_FLAG_BINARY, 900};
+    TEST_ASSERT_TRUE(publishDeviceDiscovery(client, odd));
+    TEST_ASSERT_EQUAL(client.announced, client.written);
+    TEST_ASSERT_TRUE(contains(client.lastPayload, "\"ids\":[\"Shed \\\"North\\\"\"]"));
+    TEST_ASSERT_TRUE(contains(client.lastPayload, "\"uniq_id\":\"Shed \\\"North\\\"_binary\""));
+}
+
+void test_disconnected_client_fails() {
+    client.online = false;
+    TEST_ASSERT_FALSE(publishDeviceDiscovery(client, climate));
+}
+
+void test_clear_is_empty_and_retained() {
+    TEST_ASSERT_TRUE(clearDeviceDiscovery(client, climate));
+    TEST_ASSERT_EQUAL_STRING("homeassistant/device/living_room/config", client.lastTopic);
+    TEST_ASSERT_TRUE(client.lastRetained);
+    TEST_ASSERT_EQUAL(0, client.written);
+
+    TEST_ASSERT_TRUE(clearEntityDiscovery(client, climate, DISCOVERY_ENTITIES[0]));
+    TEST_ASSERT_EQUAL_STRING("homeassistant/sensor/living_room/battery/config", client.lastTopic);
+    TEST_ASSERT_TRUE(client.lastRetained);
+    TEST_ASSERT_EQUAL(0, client.written);
+}
+
+// A migrating device has the other format's retained configs cleared first
+void test_scheduler_clears_other_format() {
+    PublishScheduler scheduler(client);
+    TEST_ASSERT_TRUE(scheduler.enqueueDiscovery(climate, true));
+    scheduler.service(1000000);
+    TEST_ASSERT_TRUE(scheduler.idle());
+
+#ifdef HA_DEVICE_DISCOVERY
+    uint32_t expected = DISCOVERY_ENTITY_COUNT + 1; // Every entity topic, then the device config
+#else
+    uint32_t expected = 1; // The device config, then every fitted entity
+    for (const EntityDesc& e : DISCOVERY_ENTITIES) if (entityEnabled(e, climate.sensorFlags)) expected++;
+#endif
+    TEST_ASSERT_EQUAL(expected, client.publishes);
+    TEST_ASSERT_EQUAL(expected, scheduler.stats().published);
+}
+
+// Replays and unchanged devices only send their own format
+void test_scheduler_without_migration() {
+    PublishScheduler scheduler(client);
+    TEST_ASSERT_TRUE(scheduler.enqueueDiscovery(climate));
+    scheduler.service(1000000);
+    TEST_ASSERT_TRUE(scheduler.idle());
+
+#ifdef HA_DEVICE_DISCOVERY
+    uint32_t expected = 1;
+#else
+    uint32_t expected = 0;
+    for (const EntityDesc& e : DISCOVERY_ENTITIES) if (entityEnabled(e, climate.sensorFlags)) expected++;
+#endif
+    TEST_ASSERT_EQUAL(expected, client.publishes);
+}
+
+// A fleet of 30 devices (the reboot storm from the request) discovered in both
+// formats. Reports bytes on the wire and time per device; the heap must not be touched.
+void test_benchmark_per_device() {
+    const uint16_t devices = 30;
+    const uint16_t rounds = 200;
+    char names[devices][24];
+    char slugs[devices][24];
+    for (uint16_t i = 0; i < devices; i++) {
+        snprintf(names[i], sizeof(names[i]), "Sensor %u", i);
+        snprintf(slugs[i], sizeof(slugs[i]), "sensor_%u", i);
+    }
+    const uint8_t allSensors = SENSOR_FLAG_BME | SENSOR_FLAG_LUX | SENSOR_FLAG_SOIL;
+
+    for (int deviceBased = 0; deviceBased < 2; deviceBased++) {
+        client = PubSubClient();
+        counting = true;
+        allocations = 0;
+        allocatedBytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint16_t r = 0; r < rounds; r++) {
+            for (uint16_t i = 0; i < devices; i++) {
+                DiscoveryDevice dev = {names[i], slugs[i], "C4:5B:BE:61:86:09", allSensors, 900};
+                if (deviceBased) {
+                    TEST_ASSERT_TRUE(publishDeviceDiscovery(client, dev));
+                } else {
+                    for (const EntityDesc& e : DISCOVERY_ENTITIES) {
+                        if (entityEnabled(e, dev.sensorFlags)) TEST_ASSERT_TRUE(publishEntityDiscovery(client, dev, e));
+                    }
+                }
+            }
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        counting = false;
+
+        uint32_t discoveries = (uint32_t)devices * rounds;
+        char msg[160];
+        snprintf(msg, sizeof(msg), "%s: %u messages, %u bytes, %.2f us per device (%.0f bytes/us), %u allocations (%u bytes)",
+                 deviceBased ? "device-based" : "per-entity", client.publishes / discoveries, client.bytes / discoveries,
+                 us / discoveries, client.bytes / us, allocations, (unsigned)allocatedBytes);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_EQUAL(0, allocations);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_entity_payload);
+    RUN_TEST(test_device_payload);
+    RUN_TEST(test_escapes_name_without_mac);
+    RUN_TEST(test_disconnected_client_fails);
+    RUN_TEST(test_clear_is_empty_and_retained);
+    RUN_TEST(test_scheduler_clears_other_format);
+    RUN_TEST(test_scheduler_without_migration);
+    RUN_TEST(test_benchmark_per_device);
+    return UNITY_END();
+}
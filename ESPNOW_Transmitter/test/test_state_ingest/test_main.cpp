@@ -0,0 +1,201 @@
+#include <unity.h>
+#include <ArduinoJson.h>
+#include <chrono>
+#include <new>
+#include "device_topics.h"
+#include "protocol_v2.h"
+#include "publish_scheduler.h"
+#include "serial_link.h"
+
+// Steady-state ingest of link frames up to the MQTT write, the way loop()
+// handles them: parse in place, look up the precomputed topics by id, expand
+// into the static JSON document, serialize into a state lane slot and stream
+// it out. Counts heap allocations per forwarded message, which must be zero.
+
+const char* mqtt_topic_base = "espnow";
+
+static bool counting = false;
+static uint32_t allocations = 0;
+
+void* operator new(size_t n) {
+    if (counting) allocations++;
+    void* p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+#ifdef __GLIBC__
+// Also catch C allocations (ArduinoJson's DynamicJsonDocument uses malloc)
+extern "C" void* __libc_malloc(size_t n);
+extern "C" void* malloc(size_t n) {
+    if (counting) allocations++;
+    return __libc_malloc(n);
+}
+#endif
+
+#define DEVICES 20
+
+static PubSubClient client;
+static PublishScheduler scheduler(client);
+static DeviceTopicTable<LINK_MAX_DEVICE_ID> deviceTopics("espnow");
+static StaticJsonDocument<512> linkDoc;
+static LinkFrameParser parser;
+
+// Wire frames as the Gateway sends them
+static uint8_t wire[DEVICES * 2 + 1][LINK_MAX_ENCODED];
+static size_t wireLen[DEVICES * 2 + 1];
+
+static uint32_t forwarded;
+
+void setUp() {}
+void tearDown() {}
+
+// Same fields as fillDataDoc() in main.cpp
+static void fillState(JsonDocument& doc, const DataMessage& data) {
+    doc["sensorFlags"] = data.sensorFlags;
+    doc["batteryVoltage"] = data.batteryVoltage;
+    if (data.sensorFlags & SENSOR_FLAG_BME) {
+        doc["temperature"] = data.bme.temperature;
+        doc["humidity"] = data.bme.humidity;
+        doc["pressure"] = data.bme.pressure;
+    }
+    if (data.sensorFlags & SENSOR_FLAG_LUX) doc["lux"] = data.lux.lux;
+    if (data.sensorFlags & SENSOR_FLAG_SOIL) doc["soil"] = data.soil.moisture;
+}
+
+static void handleFrame() {
+    uint8_t* payload = parser.payload();
+    size_t len = parser.length();
+    if (parser.type() == LINK_FRAME_DEVICE) {
+        LinkDevice dev;
+        if (linkParseDevice(payload, len, dev)) deviceTopics.set(dev.id, dev.mac, dev.name, dev.nameLen);
+    } else if (parser.type() == LINK_FRAME_RECORD) {
+        LinkRecord rec;
+        TEST_ASSERT_TRUE(linkParseRecord(payload, len, rec));
+        const DeviceTopics* dev = deviceTopics.get(rec.id);
+        TEST_ASSERT_NOT_NULL(dev);
+        SensorSample sample;
+        uint16_t seq;
+        TEST_ASSERT_TRUE(decodeDataV2(rec.packet, rec.packetLen, sample, seq));
+        DataMessage data;
+        sampleToDataMessage(sample, data);
+        linkDoc.clear();
+        linkDoc["seq"] = seq;
+        fillState(linkDoc, data);
+
+        TEST_ASSERT_LESS_THAN(PUBLISH_PAYLOAD_MAX, measureJson(linkDoc));
+        OutboundMessage* m = scheduler.reserve(LANE_STATE, dev->state);
+        TEST_ASSERT_NOT_NULL(m);
+        m->len = serializeJson(linkDoc, m->payload, sizeof(m->payload));
+        scheduler.commit(LANE_STATE);
+        forwarded++;
+    } else if (parser.type() == LINK_FRAME_JSON) {
+        // Gateway status line, parsed in place
+        TEST_ASSERT_TRUE(deserializeJson(linkDoc, (char*)payload, len) == DeserializationError::Ok);
+        TEST_ASSERT_EQUAL(DEVICES, linkDoc["devices"].as<int>());
+    }
+}
+
+static void feed(uint16_t frame) {
+    for (size_t k = 0; k < wireLen[frame]; k++) {
+        if (parser.push(wire[frame][k])) handleFrame();
+    }
+}
+
+static void buildFrames() {
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    uint16_t seq = 1;
+    for (uint16_t i = 0; i < DEVICES; i++) {
+        uint8_t mac[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, (uint8_t)i};
+        char name[DEVICE_NAME_LEN];
+        snprintf(name, sizeof(name), "Sensor Room %u", i);
+        size_t n = linkBuildDevice(i + 1, mac, name, payload);
+        wireLen[i] = linkEncodeFrame(LINK_FRAME_DEVICE, seq++, payload, n, wire[i], LINK_MAX_ENCODED);
+
+        BMEData bme = {20.0f + i * 0.1f, 50.0f, 1013.2f};
+        LuxData lux = {150.0f};
+        SoilData soil = {40.0f};
+        BinaryData binary = {false};
+        SensorSample s;
+        sampleFromReadings(SENSOR_FLAG_BME | SENSOR_FLAG_LUX | SENSOR_FLAG_SOIL, 3.71f, bme, lux, soil, binary, s);
+        uint8_t packet[DATA_V2_MAX_SIZE];
+        size_t packetLen = encodeDataV2(s, 1000 + i, packet);
+        n = linkBuildRecord(i + 1, mac, packet, packetLen, payload);
+        wireLen[DEVICES + i] = linkEncodeFrame(LINK_FRAME_RECORD, seq++, payload, n, wire[DEVICES + i], LINK_MAX_ENCODED);
+    }
+    const char status[] = "{\"type\":\"status\",\"devices\":20,\"uptime\":12345}";
+    wireLen[DEVICES * 2] = linkEncodeFrame(LINK_FRAME_JSON, seq, (const uint8_t*)status, sizeof(status) - 1,
+                                           wire[DEVICES * 2], LINK_MAX_ENCODED);
+}
+
+void test_forwarded_state() {
+    buildFrames();
+    for (uint16_t i = 0; i < DEVICES; i++) feed(i); // Announces
+    feed(DEVICES + 3);
+    scheduler.service(100000);
+    TEST_ASSERT_EQUAL_STRING("espnow/sensor_room_3/state", client.lastTopic);
+    TEST_ASSERT_FALSE(client.lastRetained);
+    TEST_ASSERT_TRUE(strstr(client.lastPayload, "\"seq\":1003") != nullptr);
+    TEST_ASSERT_TRUE(strstr(client.lastPayload, "\"temperature\":20.") != nullptr);
+    TEST_ASSERT_TRUE(strstr(client.lastPayload, "\"lux\":150") != nullptr);
+    TEST_ASSERT_EQUAL(client.announced, client.written);
+}
+
+void test_zero_allocations_per_message() {
+    const uint32_t rounds = 20000;
+    forwarded = 0;
+    uint32_t publishedBefore = client.publishes;
+    allocations = 0;
+    counting = true;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (uint16_t i = 0; i < DEVICES; i++) {
+            feed(DEVICES + i);
+            scheduler.service(100000);
+        }
+        if (r % 100 == 0) feed(DEVICES * 2);
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    counting = false;
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%u messages forwarded, %u allocations, %.2f us per message",
+             forwarded, allocations, us / forwarded);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL(rounds * DEVICES, forwarded);
+    TEST_ASSERT_EQUAL(forwarded, client.publishes - publishedBefore);
+    TEST_ASSERT_EQUAL(0, scheduler.stats().failed);
+    TEST_ASSERT_EQUAL(0, allocations);
+}
+
+static char failedTopic[PUBLISH_TOPIC_MAX];
+static uint32_t failedCount;
+static void onFailed(const OutboundMessage& m) {
+    strlcpy(failedTopic, m.topic, sizeof(failedTopic));
+    failedCount++;
+}
+
+// A state message whose publish fails is handed back (to the outbox in main.cpp)
+void test_failed_state_handed_back() {
+    PubSubClient flaky;
+    PublishScheduler s(flaky);
+    s.onStateFailed(onFailed);
+    failedCount = 0;
+    flaky.failPublish = true;
+    TEST_ASSERT_TRUE(s.enqueue(LANE_STATE, "espnow/porch/state", "{\"lux\":1}"));
+    TEST_ASSERT_TRUE(s.enqueue(LANE_AVAILABILITY, "espnow/porch/status", "online"));
+    s.service(1000000);
+    TEST_ASSERT_TRUE(s.idle());
+    TEST_ASSERT_EQUAL(1, failedCount); // Availability is not handed back
+    TEST_ASSERT_EQUAL_STRING("espnow/porch/state", failedTopic);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_forwarded_state);
+    RUN_TEST(test_zero_allocations_per_message);
+    RUN_TEST(test_failed_state_handed_back);
+    return UNITY_END();
+}
@@ -7,15 +7,19 @@
 #include <WiFiClient.h>
 #include <WiFiManager.h>
 
+#ifndef LOG_SERIAL
+#define LOG_SERIAL Serial // Debug output port, see link_port.h
+#endif
+
 static bool _common_shouldSave = false;
 inline void _common_saveCallback() { _common_shouldSave = true; }
 
 /**
  * Common logging function that sends to Serial and Telnet if connected.
  */
-inline void logToBoth(const String& msg, bool newline, WiFiClient& telnetClient) {
-    Serial.print(msg);
-    if (newline) Serial.println();
+inline void logToBoth(const char* msg, bool newline, WiFiClient& telnetClient) {
+    LOG_SERIAL.print(msg);
+    if (newline) LOG_SERIAL.println();
     
     if (telnetClient && telnetClient.connected()) {
         telnetClient.print(msg);
@@ -23,6 +27,10 @@ inline void logToBoth(const String& msg, bool newline, WiFiClient& telnetClient)
     }
 }
 
+inline void logToBoth(const String& msg, bool newline, WiFiClient& telnetClient) {
+    logToBoth(msg.c_str(), newline, telnetClient);
+}
+
 /**
  * Standardized MQTT configuration structure.
  */
@@ -81,6 +89,7 @@ inline bool saveBaseConfig(const MqttConfig& config, const char* filename = "/co
 inline void startMqttConfigPortal(MqttConfig& config, const char* apName) {
     _common_shouldSave = false;
     WiFiManager wm;
+    wm.setDebugOutput(false); // It prints to Serial, which may be the Gateway link (LINK_HW_UART)
     wm.setSaveConfigCallback(_common_saveCallback);
     
     // Setup parameters
@@ -96,7 +105,7 @@ inline void startMqttConfigPortal(MqttConfig& config, const char* apName) {
     wm.addParameter(&c_pass);
 
     if (!wm.startConfigPortal(apName)) {
-        Serial.println("failed to connect and hit timeout");
+        LOG_SERIAL.println("failed to connect and hit timeout");
         delay(3000);
         ESP.restart();
     }
@@ -112,4 +121,62 @@ inline void startMqttConfigPortal(MqttConfig& config, const char* apName) {
     }
 }
 
+/**
+ * Non-blocking variant of startMqttConfigPortal(): the portal runs while the
+ * caller's loop() keeps going. Call process() every loop; it returns true once
+ * the portal has closed (saved or timed out).
+ */
+class MqttConfigPortal {
+public:
+    void begin(MqttConfig& config, const char* apName, unsigned long timeoutSec = 180) {
+        if (_wm) return;
+        _config = &config;
+        _common_shouldSave = false;
+        _wm = new WiFiManager();
+        _wm->setDebugOutput(false); // See startMqttConfigPortal()
+        _wm->setConfigPortalBlocking(false);
+        _wm->setConfigPortalTimeout(timeoutSec);
+        _wm->setSaveConfigCallback(_common_saveCallback);
+
+        char pStr[6]; itoa(config.port, pStr, 10);
+        _server = new WiFiManagerParameter("server", "mqtt server", config.server, 40);
+        _port = new WiFiManagerParameter("port", "mqtt port", pStr, 6);
+        _user = new WiFiManagerParameter("user", "mqtt user", config.user, 40);
+        _pass = new WiFiManagerParameter("pass", "mqtt pass", config.pass, 40);
+        _wm->addParameter(_server);
+        _wm->addParameter(_port);
+        _wm->addParameter(_user);
+        _wm->addParameter(_pass);
+        _wm->startConfigPortal(apName);
+    }
+
+    bool active() const { return _wm != nullptr; }
+
+    bool process() {
+        if (!_wm) return false;
+        _wm->process();
+        if (_wm->getConfigPortalActive()) return false;
+
+        if (_common_shouldSave) {
+            strlcpy(_config->server, _server->getValue(), 40);
+            _config->port = atoi(_port->getValue());
+            strlcpy(_config->user, _user->getValue(), 40);
+            strlcpy(_config->pass, _pass->getValue(), 40);
+            saveBaseConfig(*_config);
+        }
+        delete _server; delete _port; delete _user; delete _pass;
+        delete _wm;
+        _wm = nullptr;
+        return true;
+    }
+
+private:
+    MqttConfig* _config = nullptr;
+    WiFiManager* _wm = nullptr;
+    WiFiManagerParameter* _server = nullptr;
+    WiFiManagerParameter* _port = nullptr;
+    WiFiManagerParameter* _user = nullptr;
+    WiFiManagerParameter* _pass = nullptr;
+};
+
 #endif
@@ -0,0 +1,184 @@
+#ifndef COMMAND_MAILBOX_H
+#define COMMAND_MAILBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Downlink commands waiting for a sleeping device.
+//
+// A fixed pool of slots shared by all devices, bounded per device. A command
+// is queued until the device's next uplink, then sent in one coalesced frame
+// and held in flight until the radio reports the send result: a delivered
+// command is reported and freed, a failed one is queued again. A command whose
+// result never arrives is queued again after MAIL_INFLIGHT_TIMEOUT_MS. Commands
+// that are still undelivered when their TTL runs out are reported as expired.
+// Reports are collected by drain() so they can be sent outside the Wi-Fi
+// callbacks.
+//
+// Devices are identified by their DeviceRegistry index.
+//
+// This header has no Arduino dependencies so it can be compiled on the host.
+
+#define MAIL_INFLIGHT_TIMEOUT_MS 2000 // The send callback normally reports within tens of ms
+
+enum MailState : uint8_t {
+    MAIL_FREE,
+    MAIL_QUEUED,
+    MAIL_INFLIGHT,
+    MAIL_DELIVERED, // Waiting for drain()
+    MAIL_EXPIRED    // Waiting for drain()
+};
+
+struct MailItem {
+    uint32_t expiresMs;
+    uint32_t sentMs;    // When it went in flight
+    uint16_t id;
+    uint16_t device;
+    uint8_t state;      // MailState
+    uint8_t cmdType;
+    bool value;
+    uint16_t arg0;
+    uint16_t arg1;
+};
+
+typedef void (*MailReportCallback)(const MailItem& item);
+
+template <uint8_t Capacity, uint8_t PerDevice>
+class CommandMailbox {
+public:
+    CommandMailbox() { clear(); }
+
+    void clear() {
+        memset(_items, 0, sizeof(_items));
+    }
+
+    /**
+     * Queues a command. A queued command of the same type for the device is
+     * updated in place (and keeps its id). Returns the command id, or 0 when
+     * the device or the pool is full.
+     */
+    uint16_t post(uint16_t device, uint8_t cmdType, bool value, uint16_t arg0, uint16_t arg1,
+                  uint32_t nowMs, uint32_t ttlMs) {
+        MailItem* slot = nullptr;
+        uint8_t held = 0;
+        for (uint8_t i = 0; i < Capacity; i++) {
+            MailItem& m = _items[i];
+            if (m.state == MAIL_FREE) {
+                if (!slot) slot = &m;
+                continue;
+            }
+            if (m.device != device) continue;
+            if (m.state == MAIL_QUEUED && m.cmdType == cmdType) {
+                m.value = value;
+                m.arg0 = arg0;
+                m.arg1 = arg1;
+                m.expiresMs = nowMs + ttlMs;
+                return m.id;
+            }
+            if (m.state == MAIL_QUEUED || m.state == MAIL_INFLIGHT) held++;
+        }
+        if (!slot || held >= PerDevice) return 0;
+
+        if (++_nextId == 0) _nextId = 1;
+        slot->expiresMs = nowMs + ttlMs;
+        slot->id = _nextId;
+        slot->device = device;
+        slot->state = MAIL_QUEUED;
+        slot->cmdType = cmdType;
+        slot->value = value;
+        slot->arg0 = arg0;
+        slot->arg1 = arg1;
+        return slot->id;
+    }
+
+    /**
+     * Moves up to `max` queued commands of `device` in flight, oldest first,
+     * with `lastCmd` (e.g. a restart) after the others. Returns the count.
+     */
+    uint8_t take(uint16_t device, MailItem* out, uint8_t max, uint32_t nowMs, uint8_t lastCmd = 0) {
+        uint8_t n = 0;
+        for (uint8_t pass = 0; pass < 2; pass++) {
+            for (uint16_t id = 0; n < max;) {
+                MailItem* m = oldestQueued(device, id);
+                if (!m) break;
+                id = m->id;
+                if ((m->cmdType == lastCmd) != (pass == 1)) continue;
+                m->state = MAIL_INFLIGHT;
+                m->sentMs = nowMs;
+                out[n++] = *m;
+            }
+        }
+        return n;
+    }
+
+    /**
+     * Send result for the commands in flight to `device`.
+     */
+    void settle(uint16_t device, bool delivered) {
+        for (uint8_t i = 0; i < Capacity; i++) {
+            MailItem& m = _items[i];
+            if (m.state == MAIL_INFLIGHT && m.device == device) {
+                m.state = delivered ? MAIL_DELIVERED : MAIL_QUEUED;
+            }
+        }
+    }
+
+    /**
+     * Queues every command in flight again, for when send results were lost.
+     * A command that did arrive is then sent a second time.
+     */
+    void requeueInFlight() {
+        for (uint8_t i = 0; i < Capacity; i++) {
+            if (_items[i].state == MAIL_INFLIGHT) _items[i].state = MAIL_QUEUED;
+        }
+    }
+
+    void expire(uint32_t nowMs) {
+        for (uint8_t i = 0; i < Capacity; i++) {
+            MailItem& m = _items[i];
+            if (m.state == MAIL_INFLIGHT && nowMs - m.sentMs >= MAIL_INFLIGHT_TIMEOUT_MS) m.state = MAIL_QUEUED;
+            if (m.state == MAIL_QUEUED && (int32_t)(nowMs - m.expiresMs) >= 0) m.state = MAIL_EXPIRED;
+        }
+    }
+
+    /**
+     * Reports and frees delivered and expired commands.
+     */
+    void drain(MailReportCallback report) {
+        for (uint8_t i = 0; i < Capacity; i++) {
+            MailItem& m = _items[i];
+            if (m.state == MAIL_DELIVERED || m.state == MAIL_EXPIRED) {
+                report(m);
+                m.state = MAIL_FREE;
+            }
+        }
+    }
+
+    uint8_t pending() const {
+        uint8_t n = 0;
+        for (uint8_t i = 0; i < Capacity; i++) {
+            if (_items[i].state == MAIL_QUEUED || _items[i].state == MAIL_INFLIGHT) n++;
+        }
+        return n;
+    }
+
+    uint8_t capacity() const { return Capacity; }
+
+private:
+    // Queued command of `device` with the smallest id after `afterId` (ids wrap rarely enough to ignore)
+    MailItem* oldestQueued(uint16_t device, uint16_t afterId) {
+        MailItem* best = nullptr;
+        for (uint8_t i = 0; i < Capacity; i++) {
+            MailItem& m = _items[i];
+            if (m.state != MAIL_QUEUED || m.device != device || m.id <= afterId) continue;
+            if (!best || m.id < best->id) best = &m;
+        }
+        return best;
+    }
+
+    MailItem _items[Capacity];
+    uint16_t _nextId = 0;
+};
+
+#endif
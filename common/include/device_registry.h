@@ -0,0 +1,204 @@
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Fixed-capacity device table keyed by 48-bit MAC.
+//
+// Entries live in a dense array (so an entry index is stable until clear()).
+// Two open-addressing index tables with linear probing map a MAC key and a
+// slug hash to entry indices. Nothing is allocated after construction, so
+// lookups are safe on the packet hot path.
+//
+// This header has no Arduino dependencies so it can be compiled on the host.
+
+#define DEVICE_NAME_LEN 32
+
+// Entry flags
+#define DEVICE_FLAG_SAVED     (1 << 0) // Entry is persisted in the known devices store
+#define DEVICE_FLAG_ANNOUNCED (1 << 1) // Id and name sent to the Transmitter (runtime only)
+#define DEVICE_FLAG_SEQ_SEEN  (1 << 2) // lastSeq holds the last ACKed uplink (runtime only)
+
+struct DeviceEntry {
+    uint64_t mac;        // macToKey() of the device MAC
+    uint32_t slugHash;   // fnv1a32(slug)
+    uint32_t configHash; // fnv1a32 of the last CONFIG payload, 0 if none yet
+    uint8_t flags;       // DEVICE_FLAG_*
+    uint16_t lastSeq;    // Sequence number of the last ACKed DATA/BATCH
+    char name[DEVICE_NAME_LEN];
+    char slug[DEVICE_NAME_LEN];
+};
+
+// --- Helpers ---
+
+inline uint64_t macToKey(const uint8_t* mac) {
+    uint64_t key = 0;
+    for (int i = 0; i < 6; i++) key = (key << 8) | mac[i];
+    return key;
+}
+
+inline void keyToMac(uint64_t key, uint8_t* mac) {
+    for (int i = 5; i >= 0; i--) { mac[i] = key & 0xFF; key >>= 8; }
+}
+
+inline void formatMac(const uint8_t* mac, char* out) {
+    snprintf(out, 18, "%02X:%02X:%02X:%02X:%02X:%02X",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+inline bool parseMac(const char* str, uint8_t* mac) {
+    unsigned int b[6];
+    if (sscanf(str, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6) return false;
+    for (int i = 0; i < 6; i++) mac[i] = (uint8_t)b[i];
+    return true;
+}
+
+/**
+ * Records an ACKed uplink. Returns false if `seq` repeats the previous one,
+ * i.e. the device resent a frame whose ACK came too late or was lost; it is
+ * ACKed again but must not be forwarded twice.
+ */
+inline bool deviceNoteSeq(DeviceEntry& e, uint16_t seq) {
+    if ((e.flags & DEVICE_FLAG_SEQ_SEEN) && e.lastSeq == seq) return false;
+    e.lastSeq = seq;
+    e.flags |= DEVICE_FLAG_SEQ_SEEN;
+    return true;
+}
+
+inline uint32_t fnv1a32(const uint8_t* data, size_t len, uint32_t hash = 2166136261u) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+inline uint32_t fnv1a32(const char* str) {
+    return fnv1a32((const uint8_t*)str, strlen(str));
+}
+
+/**
+ * char* counterpart of slugify() in protocol.h: spaces become '_', ASCII
+ * letters are lowercased. Always NUL-terminates. Returns the slug length.
+ */
+inline size_t slugifyInto(const char* name, char* out, size_t cap) {
+    size_t n = 0;
+    for (; name[n] != '\0' && n + 1 < cap; n++) {
+        char c = name[n];
+        if (c == ' ') c = '_';
+        else if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+        out[n] = c;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+template <uint16_t Capacity>
+class DeviceRegistry {
+    static constexpr uint16_t slotsFor(uint32_t n) {
+        return n <= 1 ? 1 : (uint16_t)(slotsFor((n + 1) / 2) * 2);
+    }
+
+public:
+    // Index tables are kept at most half full
+    static const uint16_t SLOTS = slotsFor((uint32_t)Capacity * 2);
+
+    DeviceRegistry() { clear(); }
+
+    void clear() {
+        _count = 0;
+        memset(_macIndex, 0, sizeof(_macIndex));
+        memset(_slugIndex, 0, sizeof(_slugIndex));
+    }
+
+    DeviceEntry* find(const uint8_t* mac) { return findByKey(macToKey(mac)); }
+
+    DeviceEntry* findByKey(uint64_t key) {
+        for (uint16_t s = macSlot(key);; s = (s + 1) & (SLOTS - 1)) {
+            uint16_t idx = _macIndex[s];
+            if (idx == 0) return nullptr;
+            if (_entries[idx - 1].mac == key) return &_entries[idx - 1];
+        }
+    }
+
+    DeviceEntry* findBySlug(const char* slug) {
+        uint32_t hash = fnv1a32(slug);
+        for (uint16_t s = hash & (SLOTS - 1);; s = (s + 1) & (SLOTS - 1)) {
+            uint16_t idx = _slugIndex[s];
+            if (idx == 0) return nullptr;
+            DeviceEntry& e = _entries[idx - 1];
+            if (e.slugHash == hash && strcmp(e.slug, slug) == 0) return &e;
+        }
+    }
+
+    /**
+     * Inserts a device or updates its name. Returns nullptr when full.
+     * `created` (optional) tells whether a new entry was added.
+     */
+    DeviceEntry* upsert(const uint8_t* mac, const char* name, bool* created = nullptr) {
+        uint64_t key = macToKey(mac);
+        DeviceEntry* e = findByKey(key);
+        if (created) *created = (e == nullptr);
+        if (e) {
+            if (strncmp(e->name, name, DEVICE_NAME_LEN - 1) != 0) {
+                setName(*e, name);
+                e->flags &= ~(DEVICE_FLAG_SAVED | DEVICE_FLAG_ANNOUNCED);
+                rebuildSlugIndex();
+            }
+            return e;
+        }
+        if (_count >= Capacity) return nullptr;
+
+        e = &_entries[_count++];
+        memset(e, 0, sizeof(DeviceEntry));
+        e->mac = key;
+        setName(*e, name);
+
+        uint16_t s = macSlot(key);
+        while (_macIndex[s] != 0) s = (s + 1) & (SLOTS - 1);
+        _macIndex[s] = _count;
+        insertSlug(_count - 1);
+        return e;
+    }
+
+    uint16_t size() const { return _count; }
+    uint16_t capacity() const { return Capacity; }
+    DeviceEntry& at(uint16_t i) { return _entries[i]; }
+    uint16_t indexOf(const DeviceEntry* e) const { return (uint16_t)(e - _entries); }
+
+private:
+    static uint16_t macSlot(uint64_t key) {
+        // Fibonacci hashing: the vendor OUI sits in the high bytes, so fold everything in
+        return (uint16_t)((key * 0x9E3779B97F4A7C15ull) >> 48) & (SLOTS - 1);
+    }
+
+    static void setName(DeviceEntry& e, const char* name) {
+        // strlcpy() is not in every host libc
+        size_t len = strnlen(name, DEVICE_NAME_LEN - 1);
+        memcpy(e.name, name, len);
+        e.name[len] = '\0';
+        slugifyInto(e.name, e.slug, DEVICE_NAME_LEN);
+        e.slugHash = fnv1a32(e.slug);
+    }
+
+    void insertSlug(uint16_t idx) {
+        uint16_t s = _entries[idx].slugHash & (SLOTS - 1);
+        while (_slugIndex[s] != 0) s = (s + 1) & (SLOTS - 1);
+        _slugIndex[s] = idx + 1;
+    }
+
+    void rebuildSlugIndex() {
+        memset(_slugIndex, 0, sizeof(_slugIndex));
+        for (uint16_t i = 0; i < _count; i++) insertSlug(i);
+    }
+
+    DeviceEntry _entries[Capacity];
+    uint16_t _macIndex[SLOTS];
+    uint16_t _slugIndex[SLOTS];
+    uint16_t _count;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef DEVICE_STORE_H
+#define DEVICE_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "device_registry.h"
+#include "serial_link.h" // crc16Ccitt
+
+// On-flash format of the Gateway's device store.
+//
+// An append-only log of fixed-size records, one per registration or change.
+// Replaying it in order rebuilds the registry: a later record for the same
+// MAC overrides an earlier one. Each record carries its own CRC, so a write cut
+// short by power loss only costs that record; replay stops there and the file
+// is truncated back to the last good record. The Gateway rewrites the log with
+// one record per device once it has grown well past the registry size.
+//
+// This header has no Arduino dependencies so it can be compiled on the host.
+
+#define DEVICE_RECORD_MAGIC 0xD5
+
+typedef struct __attribute__((packed)) struct_device_record {
+    uint8_t magic;        // DEVICE_RECORD_MAGIC
+    uint8_t flags;        // Persistent DEVICE_FLAG_* bits
+    uint8_t mac[6];
+    uint32_t configHash;  // fnv1a32 of the last CONFIG payload
+    char name[DEVICE_NAME_LEN];
+    uint16_t crc;         // crc16Ccitt of the preceding bytes
+} DeviceRecord;
+
+inline void deviceRecordFrom(const DeviceEntry& e, DeviceRecord& r) {
+    memset(&r, 0, sizeof(r));
+    r.magic = DEVICE_RECORD_MAGIC;
+    r.flags = e.flags & ~(DEVICE_FLAG_SAVED | DEVICE_FLAG_ANNOUNCED | DEVICE_FLAG_SEQ_SEEN);
+    keyToMac(e.mac, r.mac);
+    r.configHash = e.configHash;
+    memcpy(r.name, e.name, DEVICE_NAME_LEN);
+    r.crc = crc16Ccitt((const uint8_t*)&r, offsetof(DeviceRecord, crc));
+}
+
+inline bool deviceRecordValid(const DeviceRecord& r) {
+    return r.magic == DEVICE_RECORD_MAGIC &&
+           r.crc == crc16Ccitt((const uint8_t*)&r, offsetof(DeviceRecord, crc));
+}
+
+/**
+ * Replays a device log into `registry`. `in` needs a
+ * `size_t read(uint8_t* buf, size_t len)` member (Arduino File or a host
+ * stand-in). Loaded entries are marked DEVICE_FLAG_SAVED. Returns the byte
+ * length of the valid prefix; `records` receives its record count.
+ */
+template <class Reader, uint16_t Capacity>
+size_t deviceLogReplay(Reader& in, DeviceRegistry<Capacity>& registry, uint32_t& records) {
+    DeviceRecord r;
+    size_t valid = 0;
+    records = 0;
+    while (in.read((uint8_t*)&r, sizeof(r)) == sizeof(r) && deviceRecordValid(r)) {
+        r.name[DEVICE_NAME_LEN - 1] = '\0';
+        DeviceEntry* e = registry.upsert(r.mac, r.name);
+        if (e) {
+            e->flags = r.flags | DEVICE_FLAG_SAVED;
+            e->configHash = r.configHash;
+        }
+        valid += sizeof(r);
+        records++;
+    }
+    return valid;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef LINK_PORT_H
+#define LINK_PORT_H
+
+#include <Arduino.h>
+
+// Physical port of the Gateway <-> Transmitter link (ESP8266 only).
+//
+// LINK_HW_UART: UART0 is swapped onto D7 (RX) / D8 (TX) and runs at LINK_BAUD
+// with a LINK_RX_BUFFER byte receive buffer filled from the UART interrupt.
+// Debug output moves to Serial1, which is TX-only on D4 (and to telnet).
+// Wire D8 of one board to D7 of the other, both ways, plus GND.
+//
+// Otherwise the original SoftwareSerial link on D6 (RX) / D5 (TX) at 9600 baud
+// is used and debug output stays on the USB serial port.
+//
+// Include this before CommonUtils.h so log() follows LOG_SERIAL.
+
+#ifdef LINK_HW_UART
+
+#ifndef LINK_BAUD
+#define LINK_BAUD 460800
+#endif
+#define LINK_RX_BUFFER 4096
+#define LINK_WINDOW 8 // Frames in flight; 8 maximum-size frames fit LINK_RX_BUFFER
+#define LOG_SERIAL Serial1
+
+static HardwareSerial& linkSerial = Serial;
+
+inline void linkBegin() {
+    Serial.setRxBufferSize(LINK_RX_BUFFER);
+    Serial.begin(LINK_BAUD);
+    Serial.swap(); // GPIO13 (D7) RX, GPIO15 (D8) TX
+    LOG_SERIAL.begin(115200);
+}
+
+inline bool linkOverflowed() {
+    return Serial.hasOverrun();
+}
+
+#else
+
+#include <SoftwareSerial.h>
+
+#define LINK_BAUD 9600
+#define LINK_WINDOW 2
+#define LOG_SERIAL Serial
+
+static SoftwareSerial linkSerial(D6, D5); // RX = D6, TX = D5
+
+inline void linkBegin() {
+    LOG_SERIAL.begin(115200);
+    linkSerial.begin(LINK_BAUD);
+}
+
+inline bool linkOverflowed() {
+    return linkSerial.overflow();
+}
+
+#endif
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef LINK_QUEUE_H
+#define LINK_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Outgoing frames of the Gateway -> Transmitter link, kept until acknowledged.
+//
+// Records are [len 2][frameType 1][seq 2][payload], stored back to back in a
+// byte ring that may wrap. Three positions split the ring:
+//
+//   tail ....... sent ....... head
+//   | in flight  | not sent yet |
+//
+// push() assigns consecutive sequence numbers, next() hands out the record at
+// `sent`, ack() retires everything up to a cumulative sequence number and
+// rewind() moves `sent` back to `tail` so the unacknowledged frames go out
+// again. When the ring is full the oldest record is dropped, sent or not.
+// pushFront() slots a record in before `tail` (e.g. ahead of a SYNC), using
+// room that push() keeps free for it (setReserve()).
+//
+// Single-threaded (the Gateway's loop()). This header has no Arduino
+// dependencies so it can be compiled on the host.
+
+template <uint32_t Capacity>
+class LinkQueue {
+    static_assert(Capacity >= 64 && (Capacity & (Capacity - 1)) == 0,
+                  "LinkQueue capacity must be a power of two >= 64");
+
+public:
+    static const uint32_t HEADER_SIZE = 5;
+
+    explicit LinkQueue(uint16_t firstSeq = 1) : _nextSeq(firstSeq), _tailSeq(firstSeq), _sentSeq(firstSeq) {}
+
+    /**
+     * Queues a frame assembled from two parts (either may be empty). Returns
+     * false only if it can never fit.
+     */
+    bool push(uint8_t frameType, const void* a, uint16_t aLen, const void* b = nullptr, uint16_t bLen = 0) {
+        uint32_t len = (uint32_t)aLen + bLen;
+        uint32_t total = HEADER_SIZE + len;
+        if (total > Capacity - _reserve) return false;
+        while (_head - _tail + total > Capacity - _reserve) dropOldest();
+
+        uint8_t hdr[HEADER_SIZE] = {(uint8_t)(len & 0xFF), (uint8_t)(len >> 8), frameType,
+                                    (uint8_t)(_nextSeq & 0xFF), (uint8_t)(_nextSeq >> 8)};
+        copyIn(_head, hdr, HEADER_SIZE);
+        copyIn(_head + HEADER_SIZE, (const uint8_t*)a, aLen);
+        copyIn(_head + HEADER_SIZE + aLen, (const uint8_t*)b, bLen);
+        _head += total;
+        _nextSeq++;
+        if (_head - _tail > _highWater) _highWater = _head - _tail;
+        return true;
+    }
+
+    /**
+     * Keeps `bytes` (at most half the ring) free for pushFront(); push()
+     * drops old frames that much sooner.
+     */
+    void setReserve(uint32_t bytes) { _reserve = bytes < Capacity / 2 ? bytes : Capacity / 2; }
+
+    /**
+     * Queues a frame ahead of all others, numbered one before the oldest, and
+     * rewinds so it goes out first. Returns false, dropping nothing, if it
+     * does not fit in the free space.
+     */
+    bool pushFront(uint8_t frameType, const void* a, uint16_t aLen) {
+        uint32_t total = HEADER_SIZE + aLen;
+        if (Capacity - (_head - _tail) < total) return false;
+        rewind();
+        _tail -= total;
+        _tailSeq--;
+        uint8_t hdr[HEADER_SIZE] = {(uint8_t)(aLen & 0xFF), (uint8_t)(aLen >> 8), frameType,
+                                    (uint8_t)(_tailSeq & 0xFF), (uint8_t)(_tailSeq >> 8)};
+        copyIn(_tail, hdr, HEADER_SIZE);
+        copyIn(_tail + HEADER_SIZE, (const uint8_t*)a, aLen);
+        _sent = _tail;
+        _sentSeq = _tailSeq;
+        if (_head - _tail > _highWater) _highWater = _head - _tail;
+        return true;
+    }
+
+    bool hasUnsent() const { return _sent != _head; }
+
+    /**
+     * Copies the next unsent frame into `out` and marks it sent.
+     * Returns the payload length.
+     */
+    uint16_t next(uint8_t& frameType, uint16_t& seq, uint8_t* out, uint16_t cap) {
+        uint8_t hdr[HEADER_SIZE];
+        copyOut(_sent, hdr, HEADER_SIZE);
+        uint16_t len = hdr[0] | ((uint16_t)hdr[1] << 8);
+        frameType = hdr[2];
+        seq = hdr[3] | ((uint16_t)hdr[4] << 8);
+        copyOut(_sent + HEADER_SIZE, out, len < cap ? len : cap);
+        _sent += HEADER_SIZE + len;
+        _sentSeq = seq + 1;
+        return len;
+    }
+
+    /**
+     * Retires frames up to and including `seq`. Returns false if `seq` is not
+     * between the last retired and the last sent frame (the peer is out of sync).
+     */
+    bool ack(uint16_t seq) {
+        if ((int16_t)(seq - (uint16_t)(_tailSeq - 1)) < 0 || (int16_t)(seq - (uint16_t)(_sentSeq - 1)) > 0) {
+            return false;
+        }
+        while (_tail != _sent && (int16_t)(seq - _tailSeq) >= 0) retireOldest();
+        return true;
+    }
+
+    void rewind() {
+        _sent = _tail;
+        _sentSeq = _tailSeq;
+    }
+
+    uint16_t inFlight() const { return (uint16_t)(_sentSeq - _tailSeq); }
+    uint16_t firstSeq() const { return _tailSeq; } // Oldest frame kept (or next to be queued)
+    uint16_t lastAcked() const { return _tailSeq - 1; }
+    uint32_t used() const { return _head - _tail; }
+    uint32_t capacity() const { return Capacity; }
+    uint32_t dropped() const { return _dropped; }
+    uint32_t highWater() const { return _highWater; }
+
+private:
+    static const uint32_t MASK = Capacity - 1;
+
+    uint32_t recordSize(uint32_t pos) const {
+        return HEADER_SIZE + (_buf[pos & MASK] | ((uint16_t)_buf[(pos + 1) & MASK] << 8));
+    }
+
+    void retireOldest() {
+        _tail += recordSize(_tail);
+        _tailSeq++;
+    }
+
+    void dropOldest() {
+        bool wasSent = _sent != _tail;
+        if (!wasSent) _sent += recordSize(_tail);
+        retireOldest();
+        if (!wasSent) _sentSeq = _tailSeq;
+        _dropped++;
+    }
+
+    void copyIn(uint32_t pos, const uint8_t* src, uint32_t len) {
+        if (len == 0) return;
+        uint32_t off = pos & MASK;
+        uint32_t first = Capacity - off < len ? Capacity - off : len;
+        memcpy(_buf + off, src, first);
+        memcpy(_buf, src + first, len - first);
+    }
+
+    void copyOut(uint32_t pos, uint8_t* dst, uint32_t len) const {
+        if (len == 0) return;
+        uint32_t off = pos & MASK;
+        uint32_t first = Capacity - off < len ? Capacity - off : len;
+        memcpy(dst, _buf + off, first);
+        memcpy(dst + first, _buf, len - first);
+    }
+
+    uint8_t _buf[Capacity];
+    uint32_t _head = 0;
+    uint32_t _tail = 0;
+    uint32_t _sent = 0;
+    uint16_t _nextSeq;
+    uint16_t _tailSeq;  // Sequence number of the record at _tail
+    uint16_t _sentSeq;  // Sequence number of the record at _sent
+    uint32_t _reserve = 0;
+    uint32_t _dropped = 0;
+    uint32_t _highWater = 0;
+};
+
+#endif
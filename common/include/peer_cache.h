@@ -0,0 +1,110 @@
+#ifndef PEER_CACHE_H
+#define PEER_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Keeps the radio's peer table (about 20 entries on the ESP8266 SDK) holding
+// the most recently used peers.
+//
+// ensure() is called right before each unicast send. A peer that is already
+// registered is a hit; otherwise the least recently used peer is removed from
+// the radio to make room and the new one is added. The radio is driven through
+// two callbacks so the cache can be exercised on the host.
+//
+// This header has no Arduino dependencies so it can be compiled on the host.
+
+typedef bool (*PeerAddFn)(const uint8_t* mac, uint8_t channel);
+typedef void (*PeerDelFn)(const uint8_t* mac);
+
+struct PeerCacheStats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t addFailures;
+};
+
+template <uint8_t Slots>
+class PeerCache {
+public:
+    PeerCache(PeerAddFn add, PeerDelFn del) : _add(add), _del(del) { clear(); }
+
+    /**
+     * Forgets all peers without touching the radio (e.g. after esp_now_init()).
+     */
+    void clear() {
+        memset(_slots, 0, sizeof(_slots));
+        memset(&_stats, 0, sizeof(_stats));
+        _clock = 0;
+        _count = 0;
+    }
+
+    /**
+     * Makes sure `mac` is registered with the radio. Returns false if the
+     * radio refused to add it.
+     */
+    bool ensure(const uint8_t* mac, uint8_t channel) {
+        _clock++;
+        for (uint8_t i = 0; i < _count; i++) {
+            Slot& s = _slots[i];
+            if (memcmp(s.mac, mac, 6) == 0) {
+                if (s.channel == channel) {
+                    s.lastUse = _clock;
+                    _stats.hits++;
+                    return true;
+                }
+                // Channel changed: re-add in place
+                _stats.misses++;
+                _del(s.mac);
+                return addAt(i, mac, channel);
+            }
+        }
+        _stats.misses++;
+
+        uint8_t slot = _count;
+        if (_count == Slots) {
+            slot = 0;
+            for (uint8_t i = 1; i < Slots; i++) {
+                if (_slots[i].lastUse < _slots[slot].lastUse) slot = i;
+            }
+            _del(_slots[slot].mac);
+            _stats.evictions++;
+        } else {
+            _count++;
+        }
+        return addAt(slot, mac, channel);
+    }
+
+    uint8_t size() const { return _count; }
+    const PeerCacheStats& stats() const { return _stats; }
+
+private:
+    struct Slot {
+        uint8_t mac[6];
+        uint8_t channel;
+        uint32_t lastUse;
+    };
+
+    bool addAt(uint8_t i, const uint8_t* mac, uint8_t channel) {
+        Slot& s = _slots[i];
+        memcpy(s.mac, mac, 6);
+        s.channel = channel;
+        s.lastUse = _clock;
+        if (_add(mac, channel)) return true;
+
+        // Drop the slot so the next send retries the add
+        _stats.addFailures++;
+        _slots[i] = _slots[--_count];
+        return false;
+    }
+
+    PeerAddFn _add;
+    PeerDelFn _del;
+    Slot _slots[Slots];
+    PeerCacheStats _stats;
+    uint32_t _clock;
+    uint8_t _count;
+};
+
+#endif
@@ -1,13 +1,21 @@
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 
+#include <stdint.h>
+#ifdef ARDUINO
 #include <Arduino.h>
+#endif
 
 // Message Types
 #define MSG_CONFIG 1
 #define MSG_DATA   2
 #define MSG_ACK    3
 #define MSG_CMD    4
+#define MSG_DATA_V2 5 // Compact TLV data, see protocol_v2.h
+#define MSG_PROFILE 6 // Wake-cycle timing summary
+#define MSG_PROBE   7 // Broadcast by a Device looking for Gateways
+#define MSG_PROBE_REPLY 8 // Unicast answer from a Gateway
+#define MSG_BATCH   9 // Backlog of delta-encoded samples, see protocol_v2.h
 
 // Sensor Flags (Bitmask)
 #define SENSOR_FLAG_BME    (1 << 0) // 1
@@ -46,8 +54,12 @@ typedef struct __attribute__((packed)) struct_config_message {
     uint8_t macAddr[6];
     char deviceName[32];
     uint16_t sleepInterval;
+    uint16_t heartbeatInterval; // Longest silence with report-on-change (s), absent in v1
 } ConfigMessage;
 
+// Older devices send ConfigMessage without heartbeatInterval
+#define CONFIG_MESSAGE_V1_SIZE offsetof(ConfigMessage, heartbeatInterval)
+
 typedef struct __attribute__((packed)) struct_data_message {
     uint8_t type;         // MSG_DATA
     uint8_t sensorFlags;  // Active sensors bitmask
@@ -60,29 +72,99 @@ typedef struct __attribute__((packed)) struct_data_message {
 
 typedef struct __attribute__((packed)) struct_ack_message {
     uint8_t type;         // MSG_ACK
+    uint16_t seq;         // Sequence number of the acknowledged DATA (0 for v1)
+    uint8_t cmdType;      // Piggybacked command (CmdType), 0 = none
+    bool value;           // Piggybacked command value
+    uint16_t arg0;        // Piggybacked command arguments, see CmdMessage
+    uint16_t arg1;
 } AckMessage;
 
+// --- Wake-cycle Profile ---
+// Stages of a Device wake, in order. PHASE_AWAKE is the whole wake (reset to sleep).
+enum ProfilePhase : uint8_t {
+    PHASE_BOOT,        // Reset to setup() (ROM + bootloader + runtime init)
+    PHASE_SERIAL,      // Serial.begin() and settle delay
+    PHASE_CONFIG,      // Configuration loading
+    PHASE_SENSOR_INIT, // initSensors() + startSensors()
+    PHASE_RADIO_INIT,  // initTransport()
+    PHASE_SEND_CONFIG, // CONFIG message
+    PHASE_SENSOR_READ, // collectSensors(): what is left of the slowest conversion
+    PHASE_SEND_DATA,   // DATA message until ACK (or last retry)
+    PHASE_AWAKE,
+    PHASE_COUNT
+};
+
+// JSON keys for ProfilePhase, used by the Transmitter
+constexpr const char* PROFILE_PHASE_KEYS[PHASE_COUNT] = {
+    "boot", "serial", "config", "sensorInit", "radioInit", "sendConfig", "read", "sendData", "awake"
+};
+
+#define PROFILE_TICK_US 100 // PhaseSummary unit
+
+typedef struct __attribute__((packed)) {
+    uint16_t minTicks;
+    uint16_t avgTicks;
+    uint16_t maxTicks;
+} PhaseSummary;
+
+typedef struct __attribute__((packed)) struct_profile_message {
+    uint8_t type;         // MSG_PROFILE
+    uint8_t phaseCount;   // Entries used in phases[]
+    uint16_t wakes;       // Wakes summarised
+    PhaseSummary phases[PHASE_COUNT];
+} ProfileMessage;
+
+// --- Gateway Discovery ---
+typedef struct __attribute__((packed)) struct_probe_message {
+    uint8_t type;         // MSG_PROBE
+    uint8_t channel;      // Channel the probe was sent on
+} ProbeMessage;
+
+typedef struct __attribute__((packed)) struct_probe_reply_message {
+    uint8_t type;         // MSG_PROBE_REPLY
+    uint8_t channel;      // Gateway's ESP-NOW channel
+    uint8_t gatewayMac[6];
+} ProbeReplyMessage;
+
 // Command types for CMD messages
 enum CmdType {
     CMD_OTA = 1,
     CMD_RESTART = 2,
     CMD_UPDATE = 3,
     CMD_FLUSH = 4,
-    CMD_CONFIG = 5
-    // Future: CMD_SLEEP_DURATION, etc.
+    CMD_CONFIG = 5,
+    CMD_SLEEP = 6      // Sleep interval bounds: arg0 = min, arg1 = max (seconds)
 };
 
 typedef struct __attribute__((packed)) struct_cmd_message {
     uint8_t type;      // MSG_CMD (always 4)
     uint8_t cmdType;   // Which command (CMD_OTA, CMD_RESTART, etc.)
     bool value;        // Command state (true/false, on/off)
+    uint16_t arg0;     // Command parameters (0 if unused)
+    uint16_t arg1;
 } CmdMessage;
 
+// Older firmware sends CmdMessage without arguments
+#define CMD_MESSAGE_V1_SIZE offsetof(CmdMessage, arg0)
+
+// A CmdMessage or AckMessage may be followed by more commands, so that
+// everything queued for a device reaches it in one downlink frame.
+typedef struct __attribute__((packed)) struct_cmd_entry {
+    uint8_t cmdType;
+    bool value;
+    uint16_t arg0;
+    uint16_t arg1;
+} CmdEntry;
+
+#define DOWNLINK_MAX_CMDS 4 // Including the one in the message itself
+
 // --- Shared Utilities ---
+#ifdef ARDUINO
 inline String slugify(String name) {
     name.replace(" ", "_");
     name.toLowerCase();
     return name;
 }
+#endif
 
 #endif
@@ -0,0 +1,332 @@
+#ifndef PROTOCOL_V2_H
+#define PROTOCOL_V2_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "protocol.h"
+
+// Protocol v2 uplink: compact, versioned sensor payload.
+//
+//   [DataHeaderV2][tag len value][tag len value]...
+//
+// Scalar values are little-endian fixed-point integers written with the fewest
+// bytes that hold them; the record length gives the width. The BME280 triple
+// travels as one fixed 6-byte record. Unknown tags are skipped, so new fields
+// stay compatible. A door contact node sends 12 bytes and a fully equipped
+// node 24-25 bytes, against 27 bytes for every v1 DataMessage.
+//
+// This header has no Arduino dependencies so it can be compiled on the host.
+
+#define PROTOCOL_VERSION_2 2
+
+// TLV Tags
+#define TLV_BATTERY     1 // uint, millivolts
+#define TLV_BME         2 // int16 0.01 °C, uint16 0.1 %RH, uint16 0.1 hPa
+#define TLV_LUX         3 // uint, 0.1 lx
+#define TLV_SOIL        4 // uint, %
+#define TLV_BINARY      5 // uint, 0/1
+
+#define TLV_BME_SIZE    6
+
+typedef struct __attribute__((packed)) struct_data_header_v2 {
+    uint8_t type;         // MSG_DATA_V2
+    uint8_t version;      // PROTOCOL_VERSION_2
+    uint16_t seq;         // Per-device sequence number
+    uint8_t sensorFlags;  // Sensors present in this frame
+} DataHeaderV2;
+
+#define DATA_V2_MAX_SIZE (sizeof(DataHeaderV2) + 5 * (2 + TLV_BME_SIZE))
+
+/**
+ * Fixed-point sensor sample, the wire representation of DataMessage.
+ */
+struct SensorSample {
+    uint8_t sensorFlags;
+    uint16_t batteryMv;
+    int16_t temperature;  // 0.01 °C
+    uint16_t humidity;    // 0.1 %RH
+    uint16_t pressure;    // 0.1 hPa
+    uint32_t lux;         // 0.1 lx
+    uint8_t soil;         // %
+    uint8_t binary;
+};
+
+// --- Conversions ---
+
+inline int32_t fixedRound(float value, float scale, int32_t lo, int32_t hi) {
+    if (isnan(value)) return 0;
+    float v = value * scale;
+    if (v < (float)lo) return lo;
+    if (v > (float)hi) return hi;
+    return (int32_t)lroundf(v);
+}
+
+inline void sampleFromReadings(uint8_t sensorFlags, float batteryVoltage, const BMEData& bme,
+                               const LuxData& lux, const SoilData& soil, const BinaryData& binary,
+                               SensorSample& s) {
+    memset(&s, 0, sizeof(s));
+    s.sensorFlags = sensorFlags;
+    s.batteryMv = fixedRound(batteryVoltage, 1000.0f, 0, 65535);
+    s.temperature = fixedRound(bme.temperature, 100.0f, -32768, 32767);
+    s.humidity = fixedRound(bme.humidity, 10.0f, 0, 1000);
+    s.pressure = fixedRound(bme.pressure, 10.0f, 0, 65535);
+    s.lux = fixedRound(lux.lux, 10.0f, 0, 2000000000);
+    s.soil = fixedRound(soil.moisture, 1.0f, 0, 100);
+    s.binary = binary.state ? 1 : 0;
+}
+
+inline void sampleToDataMessage(const SensorSample& s, DataMessage& msg) {
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_DATA;
+    msg.sensorFlags = s.sensorFlags;
+    msg.batteryVoltage = s.batteryMv / 1000.0f;
+    msg.bme.temperature = s.temperature / 100.0f;
+    msg.bme.humidity = s.humidity / 10.0f;
+    msg.bme.pressure = s.pressure / 10.0f;
+    msg.lux.lux = s.lux / 10.0f;
+    msg.soil.moisture = s.soil;
+    msg.binary.state = s.binary != 0;
+}
+
+// --- TLV Encoding ---
+
+inline uint8_t* tlvPutUnsigned(uint8_t* p, uint8_t tag, uint32_t v) {
+    uint8_t n = 1;
+    while (n < 4 && (v >> (8 * n)) != 0) n++;
+    *p++ = tag;
+    *p++ = n;
+    for (uint8_t i = 0; i < n; i++) *p++ = (v >> (8 * i)) & 0xFF;
+    return p;
+}
+
+inline uint8_t* putU16(uint8_t* p, uint16_t v) {
+    *p++ = v & 0xFF;
+    *p++ = v >> 8;
+    return p;
+}
+
+inline uint16_t getU16(const uint8_t* p) {
+    return p[0] | ((uint16_t)p[1] << 8);
+}
+
+/**
+ * Encodes a v2 DATA frame. `out` must hold DATA_V2_MAX_SIZE bytes.
+ * Returns the frame length.
+ */
+inline size_t encodeDataV2(const SensorSample& s, uint16_t seq, uint8_t* out) {
+    DataHeaderV2 hdr;
+    hdr.type = MSG_DATA_V2;
+    hdr.version = PROTOCOL_VERSION_2;
+    hdr.seq = seq;
+    hdr.sensorFlags = s.sensorFlags;
+    memcpy(out, &hdr, sizeof(hdr));
+
+    uint8_t* p = out + sizeof(hdr);
+    p = tlvPutUnsigned(p, TLV_BATTERY, s.batteryMv);
+    if (s.sensorFlags & SENSOR_FLAG_BME) {
+        *p++ = TLV_BME;
+        *p++ = TLV_BME_SIZE;
+        p = putU16(p, (uint16_t)s.temperature);
+        p = putU16(p, s.humidity);
+        p = putU16(p, s.pressure);
+    }
+    if (s.sensorFlags & SENSOR_FLAG_LUX) p = tlvPutUnsigned(p, TLV_LUX, s.lux);
+    if (s.sensorFlags & SENSOR_FLAG_SOIL) p = tlvPutUnsigned(p, TLV_SOIL, s.soil);
+    if (s.sensorFlags & SENSOR_FLAG_BINARY) p = tlvPutUnsigned(p, TLV_BINARY, s.binary);
+    return p - out;
+}
+
+/**
+ * Decodes a v2 DATA frame. Returns false if the header is invalid or a record
+ * runs past the end of the frame.
+ */
+inline bool decodeDataV2(const uint8_t* in, size_t len, SensorSample& s, uint16_t& seq) {
+    if (len < sizeof(DataHeaderV2)) return false;
+    DataHeaderV2 hdr;
+    memcpy(&hdr, in, sizeof(hdr));
+    if (hdr.type != MSG_DATA_V2 || hdr.version != PROTOCOL_VERSION_2) return false;
+
+    memset(&s, 0, sizeof(s));
+    s.sensorFlags = hdr.sensorFlags;
+    seq = hdr.seq;
+
+    size_t i = sizeof(hdr);
+    while (i + 2 <= len) {
+        uint8_t tag = in[i];
+        uint8_t n = in[i + 1];
+        i += 2;
+        if (i + n > len) return false;
+        const uint8_t* v = in + i;
+        uint32_t u = 0;
+        for (uint8_t k = 0; k < n && k < 4; k++) u |= (uint32_t)v[k] << (8 * k);
+        switch (tag) {
+            case TLV_BATTERY: s.batteryMv = u; break;
+            case TLV_BME:
+                if (n < TLV_BME_SIZE) return false;
+                s.temperature = (int16_t)getU16(v);
+                s.humidity = getU16(v + 2);
+                s.pressure = getU16(v + 4);
+                break;
+            case TLV_LUX:     s.lux = u; break;
+            case TLV_SOIL:    s.soil = u; break;
+            case TLV_BINARY:  s.binary = u; break;
+            default: break; // Unknown tag: skip
+        }
+        i += n;
+    }
+    return i == len;
+}
+
+// --- Batched Backlog ---
+//
+//   [BatchHeader][record][record]...
+//
+// Each record is a sequence of zigzag varints holding the difference to the
+// previous record (the first record is relative to all-zero):
+//   dt, dseq, battery, [temperature, humidity, pressure], [lux], [soil], [binary]
+// with the bracketed fields present according to sensorFlags. In a frame, t is
+// the sample's age in seconds at send time, so the receiver rebuilds the
+// capture time from its own clock. The Device keeps its backlog in RTC memory
+// with the same encoding (t = seconds since power-on).
+
+typedef struct __attribute__((packed)) struct_batch_header {
+    uint8_t type;         // MSG_BATCH
+    uint8_t version;      // PROTOCOL_VERSION_2
+    uint8_t sensorFlags;  // Applies to every record
+    uint8_t count;        // Records in this frame
+    uint16_t lastSeq;     // Sequence number of the last record, echoed in the ACK
+} BatchHeader;
+
+#define BATCH_MAX_FRAME    250 // ESP-NOW payload limit
+#define SAMPLE_RECORD_MAX  (10 * 5) // 10 fields, 5 bytes per 32-bit varint
+
+struct TimedSample {
+    uint32_t t;
+    uint16_t seq;
+    SensorSample s;
+};
+
+inline uint8_t* putVarint(uint8_t* p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+inline const uint8_t* getVarint(const uint8_t* p, const uint8_t* end, uint32_t& v) {
+    v = 0;
+    for (uint8_t shift = 0; p < end && shift < 35; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return p;
+    }
+    return nullptr;
+}
+
+inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+/**
+ * Encodes `cur` relative to `prev`. `out` must hold SAMPLE_RECORD_MAX bytes.
+ * Returns the record length.
+ */
+inline size_t encodeSampleDelta(const TimedSample& cur, const TimedSample& prev, uint8_t sensorFlags, uint8_t* out) {
+    uint8_t* p = out;
+    p = putVarint(p, zigzag((int32_t)(cur.t - prev.t)));
+    p = putVarint(p, zigzag((int16_t)(cur.seq - prev.seq)));
+    p = putVarint(p, zigzag((int32_t)cur.s.batteryMv - prev.s.batteryMv));
+    if (sensorFlags & SENSOR_FLAG_BME) {
+        p = putVarint(p, zigzag((int32_t)cur.s.temperature - prev.s.temperature));
+        p = putVarint(p, zigzag((int32_t)cur.s.humidity - prev.s.humidity));
+        p = putVarint(p, zigzag((int32_t)cur.s.pressure - prev.s.pressure));
+    }
+    if (sensorFlags & SENSOR_FLAG_LUX) p = putVarint(p, zigzag((int32_t)(cur.s.lux - prev.s.lux)));
+    if (sensorFlags & SENSOR_FLAG_SOIL) p = putVarint(p, zigzag((int32_t)cur.s.soil - prev.s.soil));
+    if (sensorFlags & SENSOR_FLAG_BINARY) p = putVarint(p, zigzag((int32_t)cur.s.binary - prev.s.binary));
+    return p - out;
+}
+
+/**
+ * Decodes one record relative to `prev`. Returns the record length, 0 if malformed.
+ */
+inline size_t decodeSampleDelta(const uint8_t* in, size_t len, const TimedSample& prev, uint8_t sensorFlags, TimedSample& cur) {
+    const uint8_t* p = in;
+    const uint8_t* end = in + len;
+    uint32_t v;
+    cur = prev;
+    cur.s.sensorFlags = sensorFlags;
+    if (!(p = getVarint(p, end, v))) return 0;
+    cur.t = prev.t + unzigzag(v);
+    if (!(p = getVarint(p, end, v))) return 0;
+    cur.seq = prev.seq + unzigzag(v);
+    if (!(p = getVarint(p, end, v))) return 0;
+    cur.s.batteryMv = prev.s.batteryMv + unzigzag(v);
+    if (sensorFlags & SENSOR_FLAG_BME) {
+        if (!(p = getVarint(p, end, v))) return 0;
+        cur.s.temperature = prev.s.temperature + unzigzag(v);
+        if (!(p = getVarint(p, end, v))) return 0;
+        cur.s.humidity = prev.s.humidity + unzigzag(v);
+        if (!(p = getVarint(p, end, v))) return 0;
+        cur.s.pressure = prev.s.pressure + unzigzag(v);
+    }
+    if (sensorFlags & SENSOR_FLAG_LUX) {
+        if (!(p = getVarint(p, end, v))) return 0;
+        cur.s.lux = prev.s.lux + unzigzag(v);
+    }
+    if (sensorFlags & SENSOR_FLAG_SOIL) {
+        if (!(p = getVarint(p, end, v))) return 0;
+        cur.s.soil = prev.s.soil + unzigzag(v);
+    }
+    if (sensorFlags & SENSOR_FLAG_BINARY) {
+        if (!(p = getVarint(p, end, v))) return 0;
+        cur.s.binary = prev.s.binary + unzigzag(v);
+    }
+    return p - in;
+}
+
+/**
+ * Iterates the records of a MSG_BATCH frame:
+ *
+ *   BatchReader r(frame, len);
+ *   TimedSample ts;
+ *   while (r.next(ts)) { ... ts.t is the age in seconds ... }
+ */
+class BatchReader {
+public:
+    BatchReader(const uint8_t* frame, size_t len) : _frame(frame), _len(len) {
+        memset(&_prev, 0, sizeof(_prev));
+        if (len >= sizeof(BatchHeader)) {
+            memcpy(&_hdr, frame, sizeof(_hdr));
+            _valid = _hdr.type == MSG_BATCH && _hdr.version == PROTOCOL_VERSION_2;
+        }
+        _pos = sizeof(BatchHeader);
+    }
+
+    bool valid() const { return _valid; }
+    const BatchHeader& header() const { return _hdr; }
+
+    bool next(TimedSample& out) {
+        if (!_valid || _read >= _hdr.count || _pos >= _len) return false;
+        size_t n = decodeSampleDelta(_frame + _pos, _len - _pos, _prev, _hdr.sensorFlags, out);
+        if (n == 0) { _valid = false; return false; }
+        _pos += n;
+        _read++;
+        _prev = out;
+        return true;
+    }
+
+private:
+    const uint8_t* _frame;
+    size_t _len;
+    size_t _pos;
+    BatchHeader _hdr = {};
+    TimedSample _prev;
+    uint8_t _read = 0;
+    bool _valid = false;
+};
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef SERIAL_LINK_H
+#define SERIAL_LINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Binary framing for the Gateway -> Transmitter serial link.
+//
+// On the wire every frame is COBS encoded and terminated by a single 0x00:
+//   COBS( [frameType][seq lo][seq hi][payload ...][crc16 lo][crc16 hi] ) 0x00
+// The CRC (CCITT-FALSE) covers frameType + seq + payload. A receiver that
+// joins mid-stream simply resynchronises on the next 0x00 delimiter.
+//
+// Flow control: the Gateway numbers its frames and only sends while
+//   seq <= ack + window
+// where the Transmitter grants (ack, window) on its JSON line channel:
+//   {"link":"credit","ack":<last seq processed>,"win":<frames>}
+// It sends a grant after every window/2 frames and at least every
+// LINK_CREDIT_INTERVAL_MS, and adds "resend":true when it sees a gap. Frames
+// that are not acknowledged are sent again, and duplicates are dropped by seq.
+// A LINK_FRAME_SYNC (empty payload) tells the Transmitter that the next frame
+// is `seq`. The Gateway sends it after it restarts, or when it has dropped
+// frames the Transmitter is still waiting for. A restarted Transmitter drops
+// every frame until a SYNC arrives: what the Gateway is retransmitting may
+// start in the middle of a burst. Its credits carry no "ack" until then, which
+// is what asks the Gateway for the SYNC.
+//
+// Device ids: records name their sender by a small id (DeviceRegistry index + 1
+// on the Gateway). A LINK_FRAME_DEVICE announcing an id is queued ahead of the
+// first record that uses it, and again after a rename. When a restarted
+// Transmitter asks for a SYNC, all ids are announced ahead of the frames still
+// queued for it; the Gateway keeps room in its queue for them. A Transmitter
+// that meets an unknown id does not process or acknowledge that record: it
+// sends a credit with "announce":true, and the Gateway announces every id
+// ahead of it and SYNCs there, so the record arrives again. Id 0 is a sender
+// that has no id (registry full); its record carries the MAC instead.
+//
+// This header has no Arduino dependencies so it can be compiled on the host.
+
+// Frame Types
+#define LINK_FRAME_RECORD 1 // [id 2][mac 6, only if id is 0][raw ESP-NOW packet]
+#define LINK_FRAME_JSON   2 // JSON text (gateway status, heartbeat)
+#define LINK_FRAME_SYNC   3 // Next expected sequence number is this frame's seq
+#define LINK_FRAME_DEVICE 4 // [id 2][mac 6][nameLen 1][name]
+
+#define LINK_CREDIT_INTERVAL_MS 1000
+#define LINK_MAX_DEVICE_ID 64 // Ids run from 1 to the Gateway's registry capacity
+
+#define LINK_HEADER_SIZE  3 // frameType + seq
+#define LINK_MAX_PAYLOAD  300
+#define LINK_MAX_RAW      (LINK_HEADER_SIZE + LINK_MAX_PAYLOAD + 2)
+#define LINK_MAX_ENCODED  (LINK_MAX_RAW + (LINK_MAX_RAW / 254) + 2) // + COBS overhead + delimiter
+
+/**
+ * CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF).
+ */
+inline uint16_t crc16Ccitt(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/**
+ * COBS-encodes `len` bytes into `out` (no delimiter appended).
+ * `out` must hold at least len + len / 254 + 1 bytes. Returns encoded length.
+ */
+inline size_t cobsEncode(const uint8_t* in, size_t len, uint8_t* out) {
+    size_t codeIdx = 0;
+    size_t o = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] == 0) {
+            out[codeIdx] = code;
+            codeIdx = o++;
+            code = 1;
+        } else {
+            out[o++] = in[i];
+            if (++code == 0xFF) {
+                out[codeIdx] = code;
+                codeIdx = o++;
+                code = 1;
+            }
+        }
+    }
+    out[codeIdx] = code;
+    return o;
+}
+
+/**
+ * Decodes a COBS block (without delimiter). Safe to run in place (out == in).
+ * Returns decoded length, or 0 if the block is malformed.
+ */
+inline size_t cobsDecode(const uint8_t* in, size_t len, uint8_t* out) {
+    size_t i = 0;
+    size_t o = 0;
+    while (i < len) {
+        uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > len) return 0;
+        for (uint8_t k = 1; k < code; k++) out[o++] = in[i++];
+        if (code != 0xFF && i < len) out[o++] = 0;
+    }
+    return o;
+}
+
+/**
+ * Builds a complete wire frame (COBS + CRC + delimiter) into `out`.
+ * Returns number of bytes to write, or 0 if it does not fit.
+ */
+inline size_t linkEncodeFrame(uint8_t frameType, uint16_t seq, const uint8_t* payload, size_t len,
+                              uint8_t* out, size_t outCap) {
+    size_t rawLen = LINK_HEADER_SIZE + len + 2;
+    if (len > LINK_MAX_PAYLOAD || outCap < rawLen + rawLen / 254 + 2) return 0;
+    uint8_t raw[LINK_MAX_RAW];
+    raw[0] = frameType;
+    raw[1] = seq & 0xFF;
+    raw[2] = seq >> 8;
+    memcpy(raw + LINK_HEADER_SIZE, payload, len);
+    uint16_t crc = crc16Ccitt(raw, LINK_HEADER_SIZE + len);
+    raw[LINK_HEADER_SIZE + len] = crc & 0xFF;
+    raw[LINK_HEADER_SIZE + len + 1] = crc >> 8;
+    size_t n = cobsEncode(raw, rawLen, out);
+    out[n++] = 0;
+    return n;
+}
+
+/**
+ * Decoded view of a LINK_FRAME_RECORD payload. linkParseRecord() only sets
+ * `mac` for id 0; for other ids the receiver fills in `mac` and `name` from
+ * the announced device.
+ */
+struct LinkRecord {
+    uint16_t id;
+    const uint8_t* mac;
+    const char* name;       // Not NUL-terminated, see nameLen
+    uint8_t nameLen;
+    const uint8_t* packet;  // Raw ESP-NOW packet, packet[0] is the MSG_* type
+    size_t packetLen;
+};
+
+/**
+ * Decoded view of a LINK_FRAME_DEVICE payload.
+ */
+struct LinkDevice {
+    uint16_t id;
+    const uint8_t* mac;
+    const char* name;       // Not NUL-terminated, see nameLen
+    uint8_t nameLen;
+};
+
+/**
+ * Builds a LINK_FRAME_RECORD payload from a received ESP-NOW packet. `mac`
+ * is only sent when `id` is 0. `out` must hold LINK_MAX_PAYLOAD bytes.
+ * Returns its length, 0 if too long.
+ */
+inline size_t linkBuildRecord(uint16_t id, const uint8_t* mac,
+                              const uint8_t* packet, size_t packetLen, uint8_t* out) {
+    size_t head = id == 0 ? 2 + 6 : 2;
+    size_t len = head + packetLen;
+    if (len > LINK_MAX_PAYLOAD) return 0;
+    out[0] = id & 0xFF;
+    out[1] = id >> 8;
+    if (id == 0) memcpy(out + 2, mac, 6);
+    memcpy(out + head, packet, packetLen);
+    return len;
+}
+
+inline bool linkParseRecord(const uint8_t* payload, size_t len, LinkRecord& rec) {
+    if (len < 2) return false;
+    rec.id = payload[0] | ((uint16_t)payload[1] << 8);
+    size_t head = rec.id == 0 ? 2 + 6 : 2;
+    if (len < head + 1) return false;
+    rec.mac = rec.id == 0 ? payload + 2 : nullptr;
+    rec.name = nullptr;
+    rec.nameLen = 0;
+    rec.packet = payload + head;
+    rec.packetLen = len - head;
+    return true;
+}
+
+/**
+ * Builds a LINK_FRAME_DEVICE payload. `out` must hold LINK_MAX_PAYLOAD bytes.
+ * Returns its length.
+ */
+inline size_t linkBuildDevice(uint16_t id, const uint8_t* mac, const char* name, uint8_t* out) {
+    size_t nameLen = name ? strnlen(name, 32) : 0;
+    out[0] = id & 0xFF;
+    out[1] = id >> 8;
+    memcpy(out + 2, mac, 6);
+    out[8] = (uint8_t)nameLen;
+    memcpy(out + 9, name, nameLen);
+    return 9 + nameLen;
+}
+
+inline bool linkParseDevice(const uint8_t* payload, size_t len, LinkDevice& dev) {
+    if (len < 9) return false;
+    dev.id = payload[0] | ((uint16_t)payload[1] << 8);
+    dev.mac = payload + 2;
+    dev.nameLen = payload[8];
+    if (dev.id == 0 || len < 9 + (size_t)dev.nameLen) return false;
+    dev.name = (const char*)(payload + 9);
+    return true;
+}
+
+/**
+ * Incremental frame receiver. Feed it bytes as they arrive from the serial
+ * port; push() returns true once a complete, CRC-valid frame is available
+ * through type()/seq()/payload()/length(). The view stays valid until the next push().
+ */
+class LinkFrameParser {
+public:
+    bool push(uint8_t b) {
+        if (b != 0) {
+            if (_len < sizeof(_buf)) _buf[_len++] = b;
+            else _overflow = true;
+            return false;
+        }
+        // Delimiter: try to decode what we have collected
+        size_t encLen = _len;
+        bool overflowed = _overflow;
+        _len = 0;
+        _overflow = false;
+        if (encLen == 0) return false;
+        if (overflowed) { overflows++; return false; }
+
+        size_t n = cobsDecode(_buf, encLen, _buf);
+        if (n < LINK_HEADER_SIZE + 2) { decodeErrors++; return false; }
+        uint16_t crc = _buf[n - 2] | ((uint16_t)_buf[n - 1] << 8);
+        if (crc16Ccitt(_buf, n - 2) != crc) { crcErrors++; return false; }
+        _frameLen = n - LINK_HEADER_SIZE - 2;
+        frames++;
+        return true;
+    }
+
+    uint8_t type() const { return _buf[0]; }
+    uint16_t seq() const { return _buf[1] | ((uint16_t)_buf[2] << 8); }
+    const uint8_t* payload() const { return _buf + LINK_HEADER_SIZE; }
+    // Writable until the next push(), e.g. for in-place JSON parsing
+    uint8_t* payload() { return _buf + LINK_HEADER_SIZE; }
+    size_t length() const { return _frameLen; }
+
+    uint32_t frames = 0;
+    uint32_t crcErrors = 0;
+    uint32_t decodeErrors = 0;
+    uint32_t overflows = 0;
+
+private:
+    uint8_t _buf[LINK_MAX_ENCODED];
+    size_t _len = 0;
+    size_t _frameLen = 0;
+    bool _overflow = false;
+};
+
+#endif
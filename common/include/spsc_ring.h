@@ -0,0 +1,145 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Lock-free single-producer / single-consumer ring of variable-length records.
+//
+// Each record is stored as a 2-byte little-endian length followed by its bytes
+// and may wrap around the end of the storage. head/tail are free-running byte
+// positions: the producer publishes a record with a release store of head, the
+// consumer retires it with a release store of tail. Each side reads the other
+// index with acquire, so the record bytes are always visible before the index.
+//
+// With RING_DROP_OLDEST the producer may also retire the oldest record to make
+// room. Both sides then advance tail with compare-exchange; a consumer whose
+// exchange fails has copied a record that was overwritten and simply retries.
+//
+// This header has no Arduino dependencies so it can be compiled on the host.
+
+enum RingDropPolicy {
+    RING_DROP_NEWEST, // Reject the incoming record when full
+    RING_DROP_OLDEST  // Evict the oldest records until the incoming one fits
+};
+
+template <uint32_t Capacity, RingDropPolicy Policy = RING_DROP_NEWEST>
+class SpscByteRing {
+    static_assert(Capacity >= 64 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscByteRing capacity must be a power of two >= 64");
+
+public:
+    static const uint32_t HEADER_SIZE = 2;
+    static const uint32_t MAX_RECORD = (Capacity - HEADER_SIZE) < 0xFFFF ? (Capacity - HEADER_SIZE) : 0xFFFF;
+
+    /**
+     * Producer: appends one record assembled from two parts (either may be empty).
+     * Returns false if the record was dropped (full under RING_DROP_NEWEST, or too large).
+     */
+    bool push(const void* a, uint16_t aLen, const void* b = nullptr, uint16_t bLen = 0) {
+        uint32_t len = (uint32_t)aLen + bLen;
+        uint32_t total = HEADER_SIZE + len;
+        if (len > MAX_RECORD) {
+            _overflows.store(_overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        uint32_t h = _head.load(std::memory_order_relaxed);
+        uint32_t t = _tail.load(std::memory_order_acquire);
+        while (Capacity - (h - t) < total) {
+            if (Policy == RING_DROP_NEWEST) {
+                _overflows.store(_overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+            uint32_t next = t + HEADER_SIZE + readLength(t);
+            if (_tail.compare_exchange_weak(t, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                _overflows.store(_overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                t = next;
+            }
+        }
+
+        _buf[h & MASK] = len & 0xFF;
+        _buf[(h + 1) & MASK] = len >> 8;
+        copyIn(h + HEADER_SIZE, (const uint8_t*)a, aLen);
+        copyIn(h + HEADER_SIZE + aLen, (const uint8_t*)b, bLen);
+        _head.store(h + total, std::memory_order_release);
+
+        uint32_t usedNow = h + total - t;
+        if (usedNow > _highWater.load(std::memory_order_relaxed)) {
+            _highWater.store(usedNow, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * Consumer: removes the oldest record, copying at most `cap` bytes into `out`.
+     * Returns the record length (0 if empty). A record longer than `cap` is
+     * truncated, so size `out` for the largest record you push.
+     */
+    uint16_t pop(uint8_t* out, uint16_t cap) {
+        for (;;) {
+            uint32_t t = _tail.load(std::memory_order_acquire);
+            uint32_t h = _head.load(std::memory_order_acquire);
+            if (t == h) return 0;
+
+            uint16_t len = readLength(t);
+            if (len > h - t - HEADER_SIZE) continue; // Torn read under RING_DROP_OLDEST
+            copyOut(t + HEADER_SIZE, out, len < cap ? len : cap);
+
+            uint32_t next = t + HEADER_SIZE + len;
+            if (Policy == RING_DROP_OLDEST) {
+                if (!_tail.compare_exchange_strong(t, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    continue; // Producer evicted this record while we were copying it
+                }
+            } else {
+                _tail.store(next, std::memory_order_release);
+            }
+            return len;
+        }
+    }
+
+    bool empty() const {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+    uint32_t used() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    uint32_t capacity() const { return Capacity; }
+    uint32_t overflows() const { return _overflows.load(std::memory_order_relaxed); }
+    uint32_t highWater() const { return _highWater.load(std::memory_order_relaxed); }
+
+private:
+    static const uint32_t MASK = Capacity - 1;
+
+    uint16_t readLength(uint32_t pos) const {
+        return _buf[pos & MASK] | ((uint16_t)_buf[(pos + 1) & MASK] << 8);
+    }
+
+    void copyIn(uint32_t pos, const uint8_t* src, uint32_t len) {
+        if (len == 0) return;
+        uint32_t off = pos & MASK;
+        uint32_t first = Capacity - off < len ? Capacity - off : len;
+        memcpy(_buf + off, src, first);
+        memcpy(_buf, src + first, len - first);
+    }
+
+    void copyOut(uint32_t pos, uint8_t* dst, uint32_t len) const {
+        if (len == 0) return;
+        uint32_t off = pos & MASK;
+        uint32_t first = Capacity - off < len ? Capacity - off : len;
+        memcpy(dst, _buf + off, first);
+        memcpy(dst + first, _buf, len - first);
+    }
+
+    uint8_t _buf[Capacity];
+    std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _tail{0};
+    std::atomic<uint32_t> _overflows{0};
+    std::atomic<uint32_t> _highWater{0};
+};
+
+#endif